@@ -0,0 +1,328 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "align.h"
+#include "arena.h"
+#include "fileio.h"
+#include "hash.h"
+
+#define CHUNK_MIN 1024          /* Smallest content-defined chunk    */
+#define CHUNK_MAX 16384         /* Largest content-defined chunk     */
+#define CHUNK_MASK (UINT64_C(0xFFF) << 52)      /* ~4 KiB on average */
+#define READ_SIZE 1048576       /* Bytes read from a file at a time  */
+
+/* A chunk boundary is wherever the gear hash of the bytes before it hits
+   CHUNK_MASK, so boundaries depend only on nearby content and line up
+   again right after an insertion or deletion. */
+static uint64_t gear[256];
+
+static void init_gear(void)
+{
+	uint64_t state = UINT64_C(0x2545F4914F6CDD1D);
+	int i;
+
+	/* splitmix64, for a fixed table without storing it in the source. */
+	for (i = 0; i < 256; i++) {
+		uint64_t z = (state += UINT64_C(0x9E3779B97F4A7C15));
+		z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+typedef int (*chunk_callback)(void *context, const unsigned char *data,
+                              unsigned long offset, unsigned long length,
+                              uint64_t hash);
+
+/* Stream through a file and hand every chunk to the callback. */
+static int chunk_file(struct file *f, chunk_callback emit, void *context)
+{
+	unsigned char *buffer, *chunk;
+	unsigned long offset = 0, chunk_offset = 0;
+	size_t length = 0;
+	uint64_t h = 0;
+	int result = 0;
+
+	/* The read buffer and the chunk in one buffer from the arena. */
+	buffer = arena_get(READ_SIZE + CHUNK_MAX);
+	chunk = buffer != NULL ? buffer + READ_SIZE : NULL;
+	if (buffer == NULL) result = -1;
+
+	while (result == 0 && offset < f->size) {
+		size_t count = READ_SIZE, i;
+
+		if (f->size - offset < count) count = f->size - offset;
+		if (file_read_at(f, buffer, count, offset) != count) {
+			result = -1;
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			chunk[length++] = buffer[i];
+			h = (h << 1) + gear[buffer[i]];
+			if ((length >= CHUNK_MIN && (h & CHUNK_MASK) == 0) ||
+			    length == CHUNK_MAX) {
+				result = emit(context, chunk, chunk_offset, length,
+				              hash64(chunk, length, 0));
+				if (result != 0) break;
+				chunk_offset += length;
+				length = 0;
+				h = 0;
+			}
+		}
+		offset += count;
+	}
+
+	if (result == 0 && length > 0)
+		result = emit(context, chunk, chunk_offset, length,
+		              hash64(chunk, length, 0));
+
+	arena_put(buffer);
+	return result;
+}
+
+/* #####################################################################
+   ##                  CHUNK INDEX OF THE SECOND FILE                 ##
+   ##################################################################### */
+
+/* Open addressing on the chunk hash. An offset of zero marks a free slot,
+   so offsets are stored plus one. */
+struct chunk_entry {
+	uint64_t hash;
+	unsigned long offset;
+};
+
+struct chunk_index {
+	struct chunk_entry *entries;
+	unsigned long mask;
+	unsigned long count;
+};
+
+static struct chunk_entry *index_slot(struct chunk_index *index,
+                                      uint64_t hash)
+{
+	unsigned long i = (unsigned long) hash & index->mask;
+
+	while (index->entries[i].offset != 0 && index->entries[i].hash != hash)
+		i = (i + 1) & index->mask;
+	return &index->entries[i];
+}
+
+static int index_grow(struct chunk_index *index)
+{
+	struct chunk_index bigger;
+	unsigned long i;
+
+	bigger.mask = index->mask * 2 + 1;
+	bigger.count = index->count;
+	bigger.entries = calloc(bigger.mask + 1, sizeof(struct chunk_entry));
+	if (bigger.entries == NULL) return -1;
+
+	for (i = 0; i <= index->mask; i++)
+		if (index->entries[i].offset != 0)
+			*index_slot(&bigger, index->entries[i].hash) =
+				index->entries[i];
+
+	free(index->entries);
+	*index = bigger;
+	return 0;
+}
+
+/* Keep the first occurrence of each chunk. */
+static int index_chunk(void *context, const unsigned char *data,
+                       unsigned long offset, unsigned long length,
+                       uint64_t hash)
+{
+	struct chunk_index *index = context;
+	struct chunk_entry *slot;
+
+	(void) data;
+	(void) length;
+	if (index->count * 2 >= index->mask && index_grow(index) != 0)
+		return -1;
+
+	slot = index_slot(index, hash);
+	if (slot->offset == 0) {
+		slot->hash = hash;
+		slot->offset = offset + 1;
+		index->count++;
+	}
+	return 0;
+}
+
+/* #####################################################################
+   ##                 MATCHING THE FIRST FILE AGAINST IT              ##
+   ##################################################################### */
+
+struct match_job {
+	struct chunk_index *index;
+	struct alignment *map;
+	struct file *other;     /* The indexed file                  */
+	unsigned char *scratch; /* CHUNK_MAX bytes of it             */
+	long delta;             /* Delta of the last matched chunk   */
+};
+
+static int match_chunk(void *context, const unsigned char *data,
+                       unsigned long offset, unsigned long length,
+                       uint64_t hash)
+{
+	struct match_job *job = context;
+	struct alignment *map = job->map;
+	struct align_segment *last;
+	struct chunk_entry *slot = index_slot(job->index, hash);
+	int matched = slot->offset != 0;
+	long delta = matched ? (long) (slot->offset - 1) - (long) offset
+	             : job->delta;
+
+	/* The index only knows the first copy of repeated content such as
+	   padding. If the chunk is also found where the current run would
+	   put it, stay on that run instead of jumping back. */
+	if (matched && delta != job->delta && job->delta >= -(long) offset &&
+	    file_read_at(job->other, job->scratch, length,
+	                 offset + job->delta) == length &&
+	    memcmp(job->scratch, data, length) == 0)
+		delta = job->delta;
+
+	/* Extend the previous segment if this chunk continues it. */
+	if (map->count > 0) {
+		last = &map->segments[map->count - 1];
+		if (last->matched == matched && last->delta == delta) {
+			last->length += length;
+			return 0;
+		}
+	}
+
+	if (map->count == map->capacity) {
+		unsigned long capacity = map->capacity ? map->capacity * 2 : 64;
+		struct align_segment *segments = realloc(map->segments,
+		                                   capacity * sizeof(*segments));
+		if (segments == NULL) return -1;
+		map->segments = segments;
+		map->capacity = capacity;
+	}
+
+	last = &map->segments[map->count++];
+	last->offset = offset;
+	last->length = length;
+	last->delta = delta;
+	last->matched = matched;
+	job->delta = delta;
+	return 0;
+}
+
+struct alignment *align_files(struct file *file_one, struct file *file_two)
+{
+	struct chunk_index index;
+	struct match_job job;
+	struct alignment *map;
+
+	init_gear();
+
+	index.mask = 1023;
+	index.count = 0;
+	index.entries = calloc(index.mask + 1, sizeof(struct chunk_entry));
+	map = calloc(1, sizeof(*map));
+	if (index.entries == NULL || map == NULL) {
+		free(index.entries);
+		free(map);
+		return NULL;
+	}
+
+	job.index = &index;
+	job.map = map;
+	job.other = file_two;
+	job.scratch = arena_get(CHUNK_MAX);
+	job.delta = 0;
+	if (job.scratch == NULL) {
+		free(index.entries);
+		free(map);
+		return NULL;
+	}
+
+	if (chunk_file(file_two, index_chunk, &index) != 0 ||
+	    chunk_file(file_one, match_chunk, &job) != 0) {
+		align_free(map);
+		map = NULL;
+	}
+
+	free(index.entries);
+	arena_put(job.scratch);
+	return map;
+}
+
+void align_free(struct alignment *map)
+{
+	if (map == NULL) return;
+	free(map->segments);
+	free(map);
+}
+
+struct align_segment *align_find(struct alignment *map,
+                                 unsigned long offset)
+{
+	unsigned long low = 0, high = map->count;
+
+	/* Binary search for the last segment starting at or before offset. */
+	while (high - low > 1) {
+		unsigned long middle = low + (high - low) / 2;
+		if (map->segments[middle].offset <= offset) low = middle;
+		else high = middle;
+	}
+
+	if (map->count == 0 || offset >= map->segments[low].offset +
+	                                  map->segments[low].length)
+		return NULL;
+	return &map->segments[low];
+}
+
+int align_range_state(struct alignment *map, unsigned long offset,
+                      unsigned long length)
+{
+	struct align_segment *segment = align_find(map, offset);
+	unsigned long end = offset + length;
+	int state = ALIGN_SAME;
+
+	/* Segments are contiguous, so walk forward from the first one. */
+	for (; segment != NULL && segment < map->segments + map->count &&
+	       segment->offset < end; segment++) {
+		if (!segment->matched) return ALIGN_DIFFERENT;
+		if (segment->delta != 0) state = ALIGN_SHIFTED;
+	}
+
+	return state;
+}
+
+void align_print(struct alignment *map, unsigned long base_one,
+                 unsigned long base_two, FILE *out)
+{
+	unsigned long i;
+
+	for (i = 0; i < map->count; i++) {
+		struct align_segment *s = &map->segments[i];
+
+		if (s->matched)
+			fprintf(out, "0x%08lx-0x%08lx matches 0x%08lx (%+ld)\n",
+			        base_one + s->offset, base_one + s->offset + s->length - 1,
+			        base_two + (unsigned long) (s->offset + s->delta),
+			        s->delta);
+		else
+			fprintf(out, "0x%08lx-0x%08lx not found\n", base_one + s->offset,
+			        base_one + s->offset + s->length - 1);
+	}
+	fprintf(out, "%lu segment(s).\n", map->count);
+}
@@ -0,0 +1,64 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_ALIGN
+#define HEX_ALIGN
+
+#include <stdio.h>
+#include "general.h"
+
+#define ALIGN_SAME 0            /* Found at the same offset           */
+#define ALIGN_SHIFTED 1         /* Found in the other file, elsewhere */
+#define ALIGN_DIFFERENT 2       /* Not found in the other file        */
+
+/* A run of the first file, and where its content lives in the second. */
+struct align_segment {
+	unsigned long offset;   /* Start in the first file                  */
+	unsigned long length;   /* Bytes in the run                         */
+	long delta;             /* Offset in the second file minus 'offset' */
+	int matched;            /* Zero if the content wasn't found         */
+};
+
+/* Maps the first file onto the second, so that inserted or deleted bytes
+   don't throw off everything after them. Segments are sorted and cover
+   the first file without gaps. Unmatched segments carry the delta of the
+   matched segment before them. */
+struct alignment {
+	struct align_segment *segments;
+	unsigned long count;
+	unsigned long capacity;
+};
+
+/* Cut the second file into content-defined chunks and index them, then
+   look up the chunks of the first file. Both files are read once, in
+   order. Returns NULL on error. */
+struct alignment *align_files(struct file *file_one, struct file *file_two);
+void align_free(struct alignment *map);
+
+/* The segment holding 'offset', or NULL past the end of the first file. */
+struct align_segment *align_find(struct alignment *map,
+                                 unsigned long offset);
+
+/* Summarize a range of the first file as one of the ALIGN_ states. */
+int align_range_state(struct alignment *map, unsigned long offset,
+                      unsigned long length);
+
+/* Write the segments as a plain-text report, with offsets counted from
+   where the compared ranges of both files start. */
+void align_print(struct alignment *map, unsigned long base_one,
+                 unsigned long base_two, FILE *out);
+
+#endif
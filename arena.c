@@ -0,0 +1,203 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+
+#ifndef __DJGPP__
+#include <pthread.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+struct slot {
+	void *raw;              /* What malloc() returned, NULL if unused */
+	unsigned char *memory;  /* The aligned buffer within it           */
+	size_t size;            /* Usable bytes                           */
+	unsigned long used;     /* Last handed out, for LRU release       */
+	int busy;               /* Handed out right now                   */
+};
+
+static struct {
+	struct slot slots[ARENA_SLOTS];
+	size_t held;            /* Bytes in all buffers                   */
+	size_t busy;            /* Bytes in buffers handed out            */
+	size_t budget;          /* 0 until read from the environment      */
+	int huge;               /* Use huge pages for large buffers       */
+	unsigned long clock;
+} arena;
+
+#ifndef __DJGPP__
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK() pthread_mutex_lock(&arena_lock)
+#define UNLOCK() pthread_mutex_unlock(&arena_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static void configure(void)
+{
+	long megabytes = ARENA_BUDGET;
+
+	if (arena.budget != 0) return;
+	if (getenv("HEXCOMPARE_MEMORY") != NULL)
+		megabytes = atol(getenv("HEXCOMPARE_MEMORY"));
+	if (megabytes < ARENA_MIN_BUDGET) megabytes = ARENA_MIN_BUDGET;
+	arena.budget = (size_t) megabytes * 1048576;
+	arena.huge = getenv("HEXCOMPARE_HUGE_PAGES") != NULL &&
+	             atoi(getenv("HEXCOMPARE_HUGE_PAGES")) != 0;
+}
+
+static void release(struct slot *s)
+{
+	arena.held -= s->size;
+	free(s->raw);
+	s->raw = NULL;
+}
+
+static size_t alignment(size_t size)
+{
+	if (arena.huge && size >= ARENA_HUGE_ALIGN) return ARENA_HUGE_ALIGN;
+	return ARENA_ALIGN;
+}
+
+/* What a buffer of 'size' bytes takes from the budget. */
+static size_t rounded(size_t size)
+{
+	size_t align = alignment(size);
+
+	return (size + align - 1) / align * align;
+}
+
+/* Allocate a buffer into a free slot, aligned by hand so that it works
+   wherever malloc() does. */
+static int allocate(struct slot *s, size_t size)
+{
+	size_t align = alignment(size);
+
+	size = rounded(size);
+
+	if ((s->raw = malloc(size + align)) == NULL) return -1;
+	s->memory = (unsigned char *) s->raw +
+	            (align - (uintptr_t) s->raw % align) % align;
+	s->size = size;
+	arena.held += size;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (align == ARENA_HUGE_ALIGN)
+		madvise(s->memory, size, MADV_HUGEPAGE);
+#endif
+	return 0;
+}
+
+void *arena_get(size_t size)
+{
+	struct slot *best = NULL, *free_slot = NULL;
+	unsigned char *memory = NULL;
+	int i;
+
+	if (size == 0) size = 1;
+
+	LOCK();
+	configure();
+
+	/* An idle buffer of about the right size, not wasting more than
+	   half of it. */
+	for (i = 0; i < ARENA_SLOTS; i++) {
+		struct slot *s = &arena.slots[i];
+
+		if (s->raw == NULL) {
+			if (free_slot == NULL) free_slot = s;
+			continue;
+		}
+		if (s->busy || s->size < size || s->size / 2 > size) continue;
+		if (best == NULL || s->size < best->size) best = s;
+	}
+
+	if (best == NULL) {
+		/* Make room: release idle buffers, least recently used first,
+		   until the new one fits in the budget or none are left. If it
+		   still doesn't fit, the budget is exhausted by buffers in use,
+		   and the request fails. */
+		for (;;) {
+			struct slot *oldest = NULL;
+
+			for (i = 0; i < ARENA_SLOTS; i++) {
+				struct slot *s = &arena.slots[i];
+				if (s->raw != NULL && !s->busy &&
+				    (oldest == NULL || s->used < oldest->used))
+					oldest = s;
+			}
+			if (oldest == NULL || (free_slot != NULL &&
+			    arena.held + rounded(size) <= arena.budget))
+				break;
+			release(oldest);
+			if (free_slot == NULL) free_slot = oldest;
+		}
+		if (free_slot != NULL &&
+		    arena.held + rounded(size) <= arena.budget &&
+		    allocate(free_slot, size) == 0)
+			best = free_slot;
+	}
+
+	if (best != NULL) {
+		best->busy = 1;
+		best->used = ++arena.clock;
+		arena.busy += best->size;
+		memory = best->memory;
+	}
+
+	UNLOCK();
+	return memory;
+}
+
+void arena_put(void *buffer)
+{
+	int i;
+
+	if (buffer == NULL) return;
+
+	LOCK();
+	for (i = 0; i < ARENA_SLOTS; i++) {
+		struct slot *s = &arena.slots[i];
+
+		if (s->raw == NULL || s->memory != buffer) continue;
+		s->busy = 0;
+		arena.busy -= s->size;
+		break;
+	}
+	UNLOCK();
+}
+
+unsigned long arena_room(size_t size)
+{
+	unsigned long room = 0;
+
+	if (size == 0) size = 1;
+
+	LOCK();
+	configure();
+	if (arena.budget > arena.busy)
+		room = (arena.budget - arena.busy) / rounded(size);
+	UNLOCK();
+
+	return room > 0 ? room : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_ARENA
+#define HEX_ARENA
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 4096              /* Buffers start on a page        */
+#define ARENA_HUGE_ALIGN 2097152      /* Or on a huge page, if asked    */
+#define ARENA_BUDGET 256              /* Default budget, in MiB         */
+#define ARENA_MIN_BUDGET 32           /* Smallest budget, in MiB        */
+#define ARENA_SLOTS 256               /* Buffers held at most           */
+
+/* Buffers for reading and comparing, shared by the whole program. They
+   start on a page boundary, suitable for vector loads and O_DIRECT. A
+   buffer that is given back is kept, and handed out again for a request
+   of about the same size, so after the first pass reading and comparing
+   allocate nothing more. What a pass keeps, like hashes, indexes, images
+   and spooled input, is allocated by its owner.
+
+   All buffers together, in use or idle, stay within the budget, which
+   HEXCOMPARE_MEMORY sets in MiB. Idle buffers are released to make room,
+   least recently used first; a request that doesn't fit even then fails,
+   rather than wait for buffers that may never come back. With
+   HEXCOMPARE_HUGE_PAGES=1, large buffers are aligned to and backed by
+   huge pages where the system offers them. Safe to use from several
+   threads. */
+
+/* Get a buffer of at least 'size' bytes, or NULL. */
+void *arena_get(size_t size);
+
+/* Give a buffer back. NULL is ignored. */
+void arena_put(void *buffer);
+
+/* How many buffers of 'size' bytes still fit in the budget, besides the
+   ones in use, at least 1 so that work always starts. */
+unsigned long arena_room(size_t size);
+
+#endif
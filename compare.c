@@ -0,0 +1,110 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include "compare.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+unsigned long compare_count(const unsigned char *a, const unsigned char *b,
+                            size_t length)
+{
+	unsigned long equal = 0;
+	size_t i = 0;
+
+#ifdef __SSE2__
+	/* Each byte lane counts its equal bytes: a match compares to -1, and
+	   subtracting that adds one. Lanes are summed with SAD before they
+	   can overflow, i.e. every 255 rounds. */
+	__m128i zero = _mm_setzero_si128();
+
+	while (i + 16 <= length) {
+		__m128i lanes = zero;
+		__m128i sums;
+		int rounds;
+
+		for (rounds = 0; rounds < 255 && i + 16 <= length; rounds++) {
+			__m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+			__m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+			lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(x, y));
+			i += 16;
+		}
+
+		sums = _mm_sad_epu8(lanes, zero);
+		equal += (unsigned long) _mm_cvtsi128_si32(sums) +
+		         (unsigned long) _mm_cvtsi128_si32(
+		                             _mm_srli_si128(sums, 8));
+	}
+#endif
+
+	for (; i < length; i++)
+		if (a[i] == b[i]) equal++;
+
+	return (unsigned long) length - equal;
+}
+
+size_t compare_skip(const unsigned char *a, const unsigned char *b,
+                    size_t length)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	/* Skip equal stretches 16 bytes at a time. */
+	for (; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+		if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
+	}
+#else
+	/* Without SSE2, let memcmp find the first differing word. */
+	while (i + 64 <= length && memcmp(a + i, b + i, 64) == 0) i += 64;
+#endif
+
+	for (; i < length; i++)
+		if (a[i] != b[i]) break;
+
+	return i;
+}
+
+void compare_histogram(const unsigned char *a, size_t length,
+                       unsigned long *counts)
+{
+	/* Bytes are spread over four tables, so that a run of equal bytes
+	   doesn't make every increment wait for the one before it. */
+	unsigned long lanes[4][256];
+	size_t i = 0;
+	int k;
+
+	memset(lanes, 0, sizeof(lanes));
+
+	for (; i + 8 <= length; i += 8) {
+		lanes[0][a[i]]++;
+		lanes[1][a[i + 1]]++;
+		lanes[2][a[i + 2]]++;
+		lanes[3][a[i + 3]]++;
+		lanes[0][a[i + 4]]++;
+		lanes[1][a[i + 5]]++;
+		lanes[2][a[i + 6]]++;
+		lanes[3][a[i + 7]]++;
+	}
+	for (; i < length; i++) lanes[0][a[i]]++;
+
+	for (k = 0; k < 256; k++)
+		counts[k] += lanes[0][k] + lanes[1][k] + lanes[2][k] + lanes[3][k];
+}
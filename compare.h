@@ -0,0 +1,36 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_COMPARE
+#define HEX_COMPARE
+
+#include <stddef.h>
+
+/* Number of positions at which the two buffers differ. */
+unsigned long compare_count(const unsigned char *a, const unsigned char *b,
+                            size_t length);
+
+/* Index of the first position at which the buffers differ, or 'length'
+   if they are equal. */
+size_t compare_skip(const unsigned char *a, const unsigned char *b,
+                    size_t length);
+
+/* Add how often each byte value occurs in the buffer to 'counts', which
+   has 256 entries. */
+void compare_histogram(const unsigned char *a, size_t length,
+                       unsigned long *counts);
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include "diff.h"
+#include "arena.h"
+#include "compare.h"
+#include "fileio.h"
+#include "mask.h"
+
+#define DIFF_BUFFER_SIZE 65536
+
+void diff_index_init(struct diff_index *index)
+{
+	index->ranges = NULL;
+	index->count = 0;
+	index->capacity = 0;
+	index->patch = NULL;
+	index->latest_only = 0;
+}
+
+void diff_index_free(struct diff_index *index)
+{
+	free(index->ranges);
+	index->ranges = NULL;
+	index->count = 0;
+	index->capacity = 0;
+}
+
+int diff_index_add(struct diff_index *index, unsigned long offset,
+                   unsigned long length)
+{
+	return diff_index_add_counted(index, offset, length, length);
+}
+
+int diff_index_add_counted(struct diff_index *index, unsigned long offset,
+                           unsigned long length, unsigned long differing)
+{
+	struct diff_range *last;
+
+	if (length == 0) return 0;
+
+	/* Merge with the previous range if they are close enough. */
+	if (index->count > 0) {
+		last = &index->ranges[index->count - 1];
+		if (last->offset + last->length + DIFF_MERGE_GAP >= offset) {
+			if (offset + length > last->offset + last->length)
+				last->length = offset + length - last->offset;
+			if (last->differing != 0 && differing != 0)
+				last->differing += differing;
+			else
+				last->differing = 0;
+			return 0;
+		}
+	}
+
+	/* Grow the list geometrically, unless only the latest range is
+	   kept. */
+	if (index->latest_only && index->count > 0) index->count = 0;
+	if (index->count == index->capacity) {
+		unsigned long capacity = index->capacity ? index->capacity * 2 : 64;
+		struct diff_range *ranges = realloc(index->ranges,
+		                               capacity * sizeof(*ranges));
+		if (ranges == NULL) return -1;
+		index->ranges = ranges;
+		index->capacity = capacity;
+	}
+
+	index->ranges[index->count].offset = offset;
+	index->ranges[index->count].length = length;
+	index->ranges[index->count].differing = differing;
+	index->count++;
+	return 0;
+}
+
+/* Record the differing runs of two buffers read at 'offset'. Runs close
+   together go into one patch record, equal bytes in between included. */
+static int record_runs(struct diff_index *index, unsigned long offset,
+                       unsigned char *buffer_one, unsigned char *buffer_two,
+                       size_t count)
+{
+	size_t i, start, record_start = 0, record_end = 0;
+
+	/* Skip equal stretches with the vectorized kernel, then measure the
+	   differing run by hand. */
+	for (i = 0; i < count; i++) {
+		i += compare_skip(buffer_one + i, buffer_two + i, count - i);
+		if (i == count) break;
+		start = i;
+		while (i < count && buffer_one[i] != buffer_two[i]) i++;
+		if (diff_index_add(index, offset + start, i - start) != 0)
+			return -1;
+
+		if (index->patch == NULL) continue;
+		if (record_end == 0 || start - record_end > PATCH_GAP) {
+			if (patch_write(index->patch, offset + record_start,
+			                buffer_two + record_start,
+			                record_end - record_start) != 0)
+				return -1;
+			record_start = start;
+		}
+		record_end = i;
+	}
+
+	if (index->patch != NULL &&
+	    patch_write(index->patch, offset + record_start,
+	                buffer_two + record_start,
+	                record_end - record_start) != 0)
+		return -1;
+	return 0;
+}
+
+/* The bytes only the second file has go into the patch as they are. */
+static int record_tail(struct diff_index *index, struct file *file_two,
+                       unsigned long offset, unsigned char *buffer)
+{
+	while (index->patch != NULL && offset < file_two->size) {
+		size_t count = DIFF_BUFFER_SIZE;
+
+		if (file_two->size - offset < count)
+			count = file_two->size - offset;
+		if (file_read_at(file_two, buffer, count, offset) != count ||
+		    patch_write(index->patch, offset, buffer, count) != 0)
+			return -1;
+		offset += count;
+	}
+
+	return 0;
+}
+
+/* Byte-compare 'length' bytes at 'offset', which must lie within both
+   files, and record the differing runs. */
+static int compare_range(struct diff_index *index, struct file *file_one,
+                         struct file *file_two, unsigned long offset,
+                         unsigned long length, unsigned char *buffer_one,
+                         unsigned char *buffer_two)
+{
+	unsigned long end = offset + length;
+
+	while (offset < end) {
+		size_t count = DIFF_BUFFER_SIZE;
+
+		if (end - offset < count) count = end - offset;
+		if (file_read_at(file_one, buffer_one, count, offset) != count ||
+		    file_read_at(file_two, buffer_two, count, offset) != count)
+			return -1;
+		mask_apply(file_two->mask, offset, buffer_one, buffer_two, count);
+		if (record_runs(index, offset, buffer_one, buffer_two, count) != 0)
+			return -1;
+		offset += count;
+	}
+
+	return 0;
+}
+
+static int compare_ranges(struct diff_index *index, struct diff_index *coarse,
+                          struct file *file_one, struct file *file_two)
+{
+	unsigned char *buffer_one, *buffer_two;
+	unsigned long common_size, largest_size, i;
+	int result = 0;
+
+	if ((buffer_one = arena_get(2 * DIFF_BUFFER_SIZE)) == NULL) return -1;
+	buffer_two = buffer_one + DIFF_BUFFER_SIZE;
+
+	common_size = (file_one->size < file_two->size) ? file_one->size
+	              : file_two->size;
+	largest_size = (file_one->size > file_two->size) ? file_one->size
+	              : file_two->size;
+
+	if (coarse == NULL) {
+		/* Walk the common part of both files. */
+		result = compare_range(index, file_one, file_two, 0, common_size,
+		                       buffer_one, buffer_two);
+	} else {
+		/* Only the listed ranges, clipped to the common part. */
+		for (i = 0; i < coarse->count && result == 0; i++) {
+			unsigned long offset = coarse->ranges[i].offset;
+			unsigned long length = coarse->ranges[i].length;
+
+			if (offset >= common_size) break;
+			if (common_size - offset < length)
+				length = common_size - offset;
+			result = compare_range(index, file_one, file_two, offset,
+			                       length, buffer_one, buffer_two);
+		}
+	}
+
+	/* Everything past the end of the shorter file is different. */
+	if (result == 0)
+		result = diff_index_add(index, common_size,
+		                        largest_size - common_size);
+	if (result == 0)
+		result = record_tail(index, file_two, common_size, buffer_two);
+
+	arena_put(buffer_one);
+	return result;
+}
+
+int diff_index_build(struct diff_index *index, struct file *file_one,
+                     struct file *file_two)
+{
+	return compare_ranges(index, NULL, file_one, file_two);
+}
+
+int diff_index_refine(struct diff_index *index, struct diff_index *coarse,
+                      struct file *file_one, struct file *file_two)
+{
+	return compare_ranges(index, coarse, file_one, file_two);
+}
+
+int diff_index_stream(struct diff_index *index, struct file *file_one,
+                      struct file *file_two)
+{
+	unsigned char *buffer_one, *buffer_two;
+	unsigned long offset = 0, size_one = 0, size_two = 0;
+	int result = 0;
+
+	if ((buffer_one = arena_get(2 * DIFF_BUFFER_SIZE)) == NULL) return -1;
+	buffer_two = buffer_one + DIFF_BUFFER_SIZE;
+
+	/* Read both in step until both end. Past the end of the shorter one,
+	   everything is different. */
+	for (;;) {
+		size_t read_one, read_two, common;
+
+		read_one = file_read_at(file_one, buffer_one, DIFF_BUFFER_SIZE,
+		                        offset);
+		read_two = file_read_at(file_two, buffer_two, DIFF_BUFFER_SIZE,
+		                        offset);
+		if (read_one == 0 && read_two == 0) break;
+		size_one += read_one;
+		size_two += read_two;
+
+		common = (read_one < read_two) ? read_one : read_two;
+		mask_apply(file_two->mask, offset, buffer_one, buffer_two, common);
+		if (record_runs(index, offset, buffer_one, buffer_two,
+		                common) != 0 ||
+		    diff_index_add(index, offset + common,
+		                   read_one + read_two - common * 2) != 0 ||
+		    (index->patch != NULL &&
+		     patch_write(index->patch, offset + common, buffer_two + common,
+		                 read_two - common) != 0)) {
+			result = -1;
+			break;
+		}
+		offset += (read_one > read_two) ? read_one : read_two;
+	}
+
+	if (file_one->stream != NULL) file_one->size = size_one;
+	if (file_two->stream != NULL) file_two->size = size_two;
+
+	arena_put(buffer_one);
+	return result;
+}
+
+void diff_index_print(struct diff_index *index, unsigned long base_one,
+                      unsigned long base_two, FILE *out)
+{
+	unsigned long i, total = 0;
+
+	for (i = 0; i < index->count; i++) {
+		struct diff_range *range = &index->ranges[i];
+
+		fprintf(out, "0x%08lx-0x%08lx", base_one + range->offset,
+		        base_one + range->offset + range->length - 1);
+		if (base_two != base_one)
+			fprintf(out, " -> 0x%08lx-0x%08lx", base_two + range->offset,
+			        base_two + range->offset + range->length - 1);
+		fprintf(out, " %lu bytes", range->length);
+		if (range->differing != 0 && range->differing != range->length)
+			fprintf(out, ", %lu differ", range->differing);
+		fprintf(out, "\n");
+		total += range->length;
+	}
+	fprintf(out, "%lu differing range(s), %lu byte(s) in total.\n",
+	        index->count, total);
+}
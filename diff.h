@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_DIFF
+#define HEX_DIFF
+
+#include <stdio.h>
+#include "general.h"
+#include "patch.h"
+
+#define DIFF_MERGE_GAP 8        /* Equal bytes allowed inside a range */
+
+struct diff_range {
+	unsigned long offset;     /* First differing byte                  */
+	unsigned long length;     /* Number of bytes in the range          */
+	unsigned long differing;  /* Bytes in it that differ, 0 if unknown */
+};
+
+/* Sorted list of the byte ranges that differ between both files. While
+   building it, the bytes of the second file in those ranges can also be
+   written to a patch; when only the patch is wanted, 'latest_only' keeps
+   memory constant by holding on to the latest range alone. */
+struct diff_index {
+	struct diff_range *ranges;
+	unsigned long count;
+	unsigned long capacity;
+	struct patch *patch;      /* Where to write the patch, or NULL     */
+	int latest_only;          /* Keep only the latest range            */
+};
+
+void diff_index_init(struct diff_index *index);
+void diff_index_free(struct diff_index *index);
+
+/* Append a range. Ranges must be added in increasing order; one that
+   starts within DIFF_MERGE_GAP bytes of the previous range is merged into
+   it. Returns 0 on success. diff_index_add() is for runs of differing
+   bytes, diff_index_add_counted() for ranges that also hold equal bytes,
+   or whose bytes weren't compared (differing is 0). */
+int diff_index_add(struct diff_index *index, unsigned long offset,
+                   unsigned long length);
+int diff_index_add_counted(struct diff_index *index, unsigned long offset,
+                           unsigned long length, unsigned long differing);
+
+/* Compare both files byte by byte and record every differing range.
+   Bytes past the end of the shorter file count as different. */
+int diff_index_build(struct diff_index *index, struct file *file_one,
+                     struct file *file_two);
+
+/* Like diff_index_build(), but only looks at the ranges listed in
+   'coarse', e.g. the chunks whose signature hashes differ. */
+int diff_index_refine(struct diff_index *index, struct diff_index *coarse,
+                      struct file *file_one, struct file *file_two);
+
+/* Like diff_index_build(), but in a single forward pass that reads both
+   files until they end, without needing their sizes: for streams. The
+   sizes of streams are set once they have ended. */
+int diff_index_stream(struct diff_index *index, struct file *file_one,
+                      struct file *file_two);
+
+/* Write the ranges as a plain-text report, with offsets counted from
+   'base_one' on, where the compared range of the first file starts. When
+   the second file starts elsewhere, its offsets follow, after "->". */
+void diff_index_print(struct diff_index *index, unsigned long base_one,
+                      unsigned long base_two, FILE *out);
+
+#endif
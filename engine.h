@@ -0,0 +1,32 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_ENGINE
+#define HEX_ENGINE
+
+#include "general.h"
+#include "hexcompare.h"
+
+/* The part of the engine the command line builds on that isn't part of
+   the library's interface, as it exposes the files. */
+
+/* Compare files that are already open, with their signature, alignment,
+   watch and mask set up. They stay the caller's. Returns NULL on error. */
+struct hexcompare *hexcompare_attach(struct file *file_one,
+                                     struct file *file_two);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "fileio.h"
+#include "remote.h"
+
+#ifndef __DJGPP__
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+/* A pipe or other stream, spooled into chunks as far as it was read. The
+   newest chunks stay in memory; older ones spill to a temporary file, or
+   are dropped when the stream is only read forward. */
+struct stream {
+	unsigned char **chunks;     /* Chunks in memory, NULL if not       */
+	unsigned long count;        /* Number of chunks spooled so far     */
+	unsigned long capacity;     /* Number of entries in 'chunks'       */
+	unsigned long length;       /* Bytes spooled so far                */
+	unsigned long oldest;       /* First chunk still in memory         */
+	int ended;                  /* End of the stream was reached       */
+	int forward;                /* Drop old chunks instead of spilling */
+	FILE *spill;                /* Spilled chunks, created when needed */
+#ifndef __DJGPP__
+	pthread_mutex_t lock;       /* Readers may be on several threads   */
+#endif
+};
+
+/* Standard input may be named for both files, or compared against
+   itself: every file opened as "-" shares one spool of it, and the last
+   one closed closes it. */
+static struct {
+	int users;
+	struct stream *stream;
+} standard_input;
+
+/* Read one more chunk from the stream, making room in memory first. */
+static int stream_pull(struct file *f)
+{
+	struct stream *s = f->stream;
+	unsigned char *chunk;
+	size_t length;
+
+	if (s->count == s->capacity) {
+		unsigned long capacity = s->capacity ? s->capacity * 2 : 64;
+		unsigned char **chunks = realloc(s->chunks,
+		                                 capacity * sizeof(*chunks));
+		if (chunks == NULL) return -1;
+		s->chunks = chunks;
+		s->capacity = capacity;
+	}
+
+	if (s->count - s->oldest >= STREAM_MEMORY) {
+		/* Out of budget: move the oldest chunk out of memory. */
+		if (!s->forward) {
+			if (s->spill == NULL && (s->spill = tmpfile()) == NULL)
+				return -1;
+			if (fseek(s->spill, s->oldest * STREAM_CHUNK, SEEK_SET) != 0 ||
+			    fwrite(s->chunks[s->oldest], 1, STREAM_CHUNK,
+			           s->spill) != STREAM_CHUNK)
+				return -1;
+		}
+		free(s->chunks[s->oldest]);
+		s->chunks[s->oldest++] = NULL;
+	}
+
+	if ((chunk = malloc(STREAM_CHUNK)) == NULL) return -1;
+	length = fread(chunk, 1, STREAM_CHUNK, f->pointer);
+	if (length < STREAM_CHUNK) s->ended = 1;
+	if (length == 0) {
+		free(chunk);
+		return 0;
+	}
+
+	s->chunks[s->count++] = chunk;
+	s->length += length;
+	return 0;
+}
+
+/* Read from the spool, pulling from the stream as far as needed. */
+static size_t stream_read(struct file *f, unsigned char *buffer,
+                          size_t length, unsigned long offset)
+{
+	struct stream *s = f->stream;
+	size_t done = 0;
+
+#ifndef __DJGPP__
+	pthread_mutex_lock(&s->lock);
+#endif
+	while (!s->ended && s->length < offset + length)
+		if (stream_pull(f) != 0) break;
+
+	if (offset >= s->length) length = 0;
+	else if (s->length - offset < length) length = s->length - offset;
+
+	while (done < length) {
+		unsigned long chunk = (offset + done) / STREAM_CHUNK;
+		size_t skip = (offset + done) % STREAM_CHUNK;
+		size_t count = STREAM_CHUNK - skip;
+
+		if (count > length - done) count = length - done;
+		if (s->chunks[chunk] != NULL) {
+			memcpy(buffer + done, s->chunks[chunk] + skip, count);
+		} else if (chunk < s->oldest && s->spill != NULL) {
+			if (fseek(s->spill, chunk * STREAM_CHUNK + skip,
+			          SEEK_SET) != 0 ||
+			    fread(buffer + done, 1, count, s->spill) != count)
+				break;
+		} else {
+			/* Dropped: this stream is read forward only. */
+			break;
+		}
+		done += count;
+	}
+#ifndef __DJGPP__
+	pthread_mutex_unlock(&s->lock);
+#endif
+
+	return done;
+}
+
+/* Find out the size of what the file name refers to. Returns 1 if it's a
+   stream whose size isn't known until it has been read. */
+static int find_size(struct file *f)
+{
+	struct stat status;
+	long size;
+
+	if (fstat(fileno(f->pointer), &status) == 0) {
+		if (S_ISREG(status.st_mode)) {
+			f->size = status.st_size;
+			return 0;
+		}
+#ifdef __linux__
+		if (S_ISBLK(status.st_mode)) {
+			uint64_t bytes;
+			if (ioctl(fileno(f->pointer), BLKGETSIZE64, &bytes) == 0) {
+				f->size = bytes;
+				return 0;
+			}
+		}
+#endif
+	}
+
+	/* Anything that can't seek to its end is taken as a stream. */
+	if (fseek(f->pointer, 0, SEEK_END) != 0 ||
+	    (size = ftell(f->pointer)) < 0)
+		return 1;
+	fseek(f->pointer, 0, SEEK_SET);
+	f->size = size;
+	return 0;
+}
+
+int file_open(struct file *f, const char *name)
+{
+	f->name = name;
+	f->size = 0;
+	f->signature = NULL;
+	f->remote = NULL;
+	f->alignment = NULL;
+	f->watch = NULL;
+	f->stream = NULL;
+	f->start = 0;
+	f->limit = FILE_WHOLE;
+	f->mask = NULL;
+
+	if (strcmp(name, "-") == 0) {
+		f->pointer = stdin;
+		if (standard_input.users++ > 0) {
+			/* Opened before: a file's size is known already, a stream's
+			   once file_spool() has read it to its end. */
+			if ((f->stream = standard_input.stream) == NULL) find_size(f);
+			return 0;
+		}
+	} else if ((f->pointer = fopen(name, "rb")) == NULL) {
+		return -1;
+	}
+
+	if (find_size(f) == 0) return 0;
+
+	if ((f->stream = calloc(1, sizeof(*f->stream))) == NULL) {
+		file_close(f);
+		return -1;
+	}
+#ifndef __DJGPP__
+	pthread_mutex_init(&f->stream->lock, NULL);
+#endif
+	if (f->pointer == stdin) standard_input.stream = f->stream;
+	return 0;
+}
+
+void file_close(struct file *f)
+{
+	struct stream *s = f->stream;
+
+	if (f->pointer == stdin && --standard_input.users > 0) {
+		/* Still in use as the other file. */
+		f->stream = NULL;
+		f->pointer = NULL;
+		return;
+	}
+	if (f->pointer == stdin) standard_input.stream = NULL;
+
+	if (s != NULL) {
+		unsigned long i;
+
+		for (i = s->oldest; i < s->count; i++) free(s->chunks[i]);
+		free(s->chunks);
+		if (s->spill != NULL) fclose(s->spill);
+#ifndef __DJGPP__
+		pthread_mutex_destroy(&s->lock);
+#endif
+		free(s);
+		f->stream = NULL;
+	}
+	if (f->pointer != NULL) fclose(f->pointer);
+	f->pointer = NULL;
+}
+
+int file_spool(struct file *f)
+{
+	struct stream *s = f->stream;
+
+	if (s == NULL) return 0;
+	while (!s->ended)
+		if (stream_pull(f) != 0) return -1;
+	f->size = s->length;
+	return 0;
+}
+
+int file_window(struct file *f, unsigned long start, unsigned long length)
+{
+	if (start > f->size) return -1;
+	f->start = start;
+	f->limit = length;
+	file_resize(f, f->size);
+	return 0;
+}
+
+void file_resize(struct file *f, unsigned long size)
+{
+	size = (size > f->start) ? size - f->start : 0;
+	f->size = (size < f->limit) ? size : f->limit;
+}
+
+void file_forward_only(struct file *f)
+{
+	if (f->stream != NULL) f->stream->forward = 1;
+}
+
+size_t file_read_at(struct file *f, void *buffer, size_t length,
+                    unsigned long offset)
+{
+	size_t done = 0;
+
+	/* Within a range, offsets count from its start. */
+	if (f->start != 0 || f->limit != FILE_WHOLE) {
+		if (offset >= f->size) return 0;
+		if (f->size - offset < length) length = f->size - offset;
+		offset += f->start;
+	}
+
+	if (f->remote != NULL) return remote_read(f->remote, buffer, length,
+	                                          offset);
+	if (f->stream != NULL) return stream_read(f, buffer, length, offset);
+	if (f->pointer == NULL) return 0;
+
+#ifdef __DJGPP__
+	/* No pread() here, and no threads either: seek and read. */
+	if (fseek(f->pointer, offset, SEEK_SET) != 0) return 0;
+	done = fread(buffer, 1, length, f->pointer);
+#else
+	while (done < length) {
+		ssize_t result = pread(fileno(f->pointer),
+		                       (char *) buffer + done, length - done,
+		                       (off_t) (offset + done));
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) break;
+		done += result;
+	}
+#endif
+
+	return done;
+}
+
+void file_advise(struct file *f, unsigned long offset, unsigned long length)
+{
+	if (f->remote != NULL || f->stream != NULL || f->pointer == NULL ||
+	    length == 0)
+		return;
+
+#if !defined(__DJGPP__) && defined(POSIX_FADV_WILLNEED)
+	posix_fadvise(fileno(f->pointer), (off_t) (f->start + offset),
+	              (off_t) length, POSIX_FADV_WILLNEED);
+#else
+	(void) offset;
+#endif
+}
@@ -0,0 +1,62 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_FILEIO
+#define HEX_FILEIO
+
+#include <stddef.h>
+#include "general.h"
+
+#define STREAM_CHUNK 1048576    /* Bytes per chunk of a spooled stream */
+#define STREAM_MEMORY 64        /* Chunks of a stream kept in memory   */
+
+/* Open a file for reading and determine its size: from the file system,
+   or with an ioctl for block devices. "-" is standard input. Pipes and
+   other streams are spooled as they are read, their size stays 0 until
+   file_spool(). Returns 0, or -1 on error. */
+int file_open(struct file *f, const char *name);
+void file_close(struct file *f);
+
+/* Read a stream to its end so its size is known. Chunks beyond the
+   memory budget spill to a temporary file. Does nothing for files. */
+int file_spool(struct file *f);
+
+/* Let a stream drop chunks once they are behind, instead of spilling
+   them: for a single forward pass over it. */
+void file_forward_only(struct file *f);
+
+/* Restrict a file to at most 'length' bytes from 'start', or to its end
+   with FILE_WHOLE. Offsets then count from 'start', and the size is that
+   of the range. Returns -1 if 'start' lies past the end of the file. */
+int file_window(struct file *f, unsigned long start, unsigned long length);
+
+/* Set the size of a file from that of the whole file, e.g. after it
+   changed, keeping to its range. */
+void file_resize(struct file *f, unsigned long size);
+
+/* Read up to 'length' bytes at 'offset' without touching the stream
+   position, so several threads may read the same file at once. Returns
+   the number of bytes read; short only at end of file or on error.
+   Remote files are read through their agent, from one thread only. */
+size_t file_read_at(struct file *f, void *buffer, size_t length,
+                    unsigned long offset);
+
+/* Tell the system that a range will be read soon, so it can start reading
+   it in the background. Only plain local files have a say in this; for
+   anything else, it does nothing. */
+void file_advise(struct file *f, unsigned long offset, unsigned long length);
+
+#endif
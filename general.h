@@ -20,10 +20,27 @@
 
 #define PVER "1.0.4"
 
+struct alignment;
+struct signature;
+struct remote;
+struct watch;
+struct stream;
+struct mask;
+
+#define FILE_WHOLE ((unsigned long) -1) /* No limit on the compared length */
+
 struct file {
-	char *name;           /* File name       */
-	FILE *pointer;        /* File descriptor */
-	unsigned long size;   /* File size       */
+	const char *name;             /* File name                        */
+	FILE *pointer;                /* File descriptor, may be NULL     */
+	unsigned long size;           /* File size                        */
+	struct signature *signature;  /* Block hashes, or NULL            */
+	struct remote *remote;        /* Agent serving the file, or NULL  */
+	struct alignment *alignment;  /* Map from the first file, or NULL */
+	struct watch *watch;          /* Changes to both files, or NULL   */
+	struct stream *stream;        /* Spool of a pipe, or NULL         */
+	unsigned long start;          /* Where the compared range begins  */
+	unsigned long limit;          /* Its length at most, or FILE_WHOLE */
+	struct mask *mask;            /* Ranges to ignore, or NULL        */
 };
 
 #endif
@@ -14,6 +14,11 @@
  */
 
 #include "gui.h"
+#include "hexcompare.h"
+
+#ifndef __DJGPP__
+#include <unistd.h>
+#endif
 
 /* #####################################################################
    ##              ANCILLARY MATHEMATICAL FUNCTIONS                   ##
@@ -81,6 +86,30 @@ static int calculate_max_offset_characters(unsigned long fsz)
 	return(strlen(s));
 }
 
+/* Whether the view shows the offsets of both files: when they are
+   aligned, or compared from different offsets. */
+static int calculate_two_offsets(struct hexcompare *engine)
+{
+	return (hexcompare_flags(engine) & HEXCOMPARE_ALIGNED) ||
+	       hexcompare_start(engine, 0) != hexcompare_start(engine, 1);
+}
+
+/* Same, for offsets within the whole files. With two offsets, the
+   margin holds both, "0x<one> 0x<two>". */
+static int calculate_offset_margin(struct hexcompare *engine,
+                                   unsigned long largest_file_size)
+{
+	unsigned long start = (hexcompare_start(engine, 0) >
+	                       hexcompare_start(engine, 1)) ?
+	                      hexcompare_start(engine, 0) :
+	                      hexcompare_start(engine, 1);
+	int characters = calculate_max_offset_characters(start +
+	                                                 largest_file_size);
+
+	if (calculate_two_offsets(engine)) return characters * 2 + 3;
+	return characters;
+}
+
 /* #####################################################################
    ##                    SCREEN HANDLING FUNCTIONS                    ##
    ##################################################################### */
@@ -91,6 +120,26 @@ static char raw_to_ascii(char input)
 	return '.';
 }
 
+/* Ask for a line of input on the bottom row. Returns its length. */
+static int prompt(int width, int height, const char *question,
+                  char *answer, int size)
+{
+	int i;
+
+	attron(COLOR_PAIR(TITLE_BAR) | A_BOLD);
+	for (i = 0; i < width; i++) mvprintw(height-1, i, " ");
+	mvprintw(height-1, SIDE_MARGIN, "%s", question);
+	attroff(COLOR_PAIR(TITLE_BAR) | A_BOLD);
+
+	echo();
+	curs_set(1);
+	if (getnstr(answer, size - 1) != OK) answer[0] = '\0';
+	curs_set(0);
+	noecho();
+
+	return strlen(answer);
+}
+
 /* #####################################################################
    ##                      HANDLE MOUSE ACTIONS                       ##
    ##################################################################### */
@@ -134,12 +183,13 @@ static void mouse_clicked(unsigned long *file_offset, unsigned long
    ##                      GENERATE TITLE BAR                         ##
    ##################################################################### */
 
-static void generate_titlebar(struct file *file_one, struct file *file_two,
+static void generate_titlebar(struct hexcompare *engine,
                        unsigned long file_offset, int width, int height,
-                       char mode, int display)
+                       char mode, int display, int progress,
+                       struct hexcompare_stats *stats, int layer)
 {
 	int i;
-	char title_offset[32];
+	char title_offset[192];
 	char bottom_message[128];
 
 	/* Define and set colour for the title bar. */
@@ -154,10 +204,38 @@ static void generate_titlebar(struct file *file_one, struct file *file_two,
 
 	/* Create the title. */
 	mvprintw(0, SIDE_MARGIN, "hexcompare: %s vs. %s",
-	         file_one->name, file_two->name);
+	         hexcompare_name(engine, 0), hexcompare_name(engine, 1));
+
+	/* Indicate file offset, and where it lands in the second file when
+	   the files are aligned or compared from different offsets. */
+	if (calculate_two_offsets(engine)) {
+		sprintf(title_offset, " 0x%04lx -> 0x%04lx",
+		        hexcompare_start(engine, 0) + file_offset,
+		        hexcompare_start(engine, 1) +
+		        hexcompare_aligned_offset(engine, file_offset));
+	} else {
+		sprintf(title_offset, " 0x%04lx",
+		        hexcompare_start(engine, 0) + file_offset);
+	}
+	if (progress >= 0) {
+		char verifying[32];
+		sprintf(verifying, " [verifying %d%%]", progress);
+		memmove(title_offset + strlen(verifying), title_offset,
+		        strlen(title_offset) + 1);
+		memcpy(title_offset, verifying, strlen(verifying));
+	}
 
-	/* Indicate file offset. */
-	sprintf(title_offset, " 0x%04x", (unsigned int) file_offset);
+	/* In a statistics layer, describe the bytes of the current block. */
+	if (stats != NULL && stats->length > 0) {
+		char summary[96];
+		sprintf(summary, " [file %d: %.2f bits/byte, %d%% zeros, "
+		        "0x%02x %d%%]", layer == LAYER_STATS_ONE ? 1 : 2,
+		        stats->entropy, (int) (stats->zeros * 100),
+		        stats->common, (int) (stats->common_share * 100));
+		memmove(title_offset + strlen(summary), title_offset,
+		        strlen(title_offset) + 1);
+		memcpy(title_offset, summary, strlen(summary));
+	}
 	mvprintw(0, width-strlen(title_offset)-SIDE_MARGIN, "%s",
 	         title_offset);
 
@@ -170,6 +248,8 @@ static void generate_titlebar(struct file *file_one, struct file *file_two,
 		strcat(bottom_message, "ASCII Mode: m | ");
 	}
 
+	strcat(bottom_message, "Find: / n N | ");
+
 	if (mode == OVERVIEW_MODE) {
 		strcat(bottom_message, "Full View: v | Page & Arrow Keys to Move");
 	} else {
@@ -188,80 +268,159 @@ static void generate_titlebar(struct file *file_one, struct file *file_two,
    ##            GENERATE BLOCK DATA FOR OVERVIEW MODE                ##
    ##################################################################### */
 
-static char *generate_blocks(struct file *file_one, struct file *file_two,
-                 char *block_cache, int total_blocks,
-                 unsigned long bytes_per_block,
-                 int blocks_with_excess_byte)
+/* A block verified a part at a time, as it holds more bytes than one
+   batch: how far it got, and what its parts so far add up to. */
+struct partial_block {
+	unsigned long done;
+	char state;
+	unsigned long mismatches;
+};
+
+/* Whether blocks this large are verified a part at a time: when a batch
+   of whole blocks wouldn't keep every thread busy. */
+static int verify_in_parts(unsigned long bytes_per_block)
 {
-	int i;
-	unsigned char *block_one, *block_two;
+	return bytes_per_block + 1 >
+	       VERIFY_BATCH / (unsigned long) hexcompare_threads();
+}
 
-	block_one = malloc(bytes_per_block + 1);
-	block_two = malloc(bytes_per_block + 1);
+/* How many whole blocks to verify before checking for a key again: no
+   more bytes than a batch, so that keys don't lag. */
+static int verify_batch(int next_unverified, int total_blocks,
+                        unsigned long bytes_per_block)
+{
+	unsigned long count = VERIFY_BATCH / (bytes_per_block + 1);
 
-	/* De-allocate existing memory that holds the block data. */
-	if (block_cache != NULL) free(block_cache);
+	if (count < 1) count = 1;
+	return count < (unsigned long) (total_blocks - next_unverified) ?
+	       (int) count : total_blocks - next_unverified;
+}
 
-	/* Allocate the correct amount of memory and initialize it. */
-	block_cache = malloc(total_blocks);
-	memset(block_cache, BLOCK_EMPTY, total_blocks);
+/* Verify the next part of a large block, no more bytes than a batch, cut
+   into a piece per thread. Returns 1 once the whole block is verified
+   and in the caches, 0 while parts of it are left, or -1 on error, after
+   which the same part is tried again. */
+static int verify_part(struct hexcompare *engine, int block,
+                       int total_blocks, struct partial_block *partial,
+                       char *block_cache, unsigned long *mismatch_counts)
+{
+	char states[VERIFY_PIECES];
+	unsigned long counts[VERIFY_PIECES];
+	unsigned long offset, length, part;
+	int pieces = hexcompare_threads(), i;
+
+	if (pieces > VERIFY_PIECES) pieces = VERIFY_PIECES;
+	hexcompare_block_range(engine, block, total_blocks, &offset, &length);
+	part = length - partial->done;
+	if (part > VERIFY_BATCH) part = VERIFY_BATCH;
+
+	if (hexcompare_pieces(engine, offset + partial->done, part, pieces,
+	                      states, counts) != 0)
+		return -1;
+
+	/* The block differs if any part does, and is empty only if all of
+	   them are. */
+	for (i = 0; i < pieces; i++) {
+		if (states[i] == BLOCK_DIFFERENT ||
+		    partial->state == BLOCK_EMPTY ||
+		    (states[i] == BLOCK_SHIFTED && partial->state == BLOCK_SAME))
+			partial->state = states[i];
+		if (counts[i] == MISMATCH_UNKNOWN ||
+		    partial->mismatches == MISMATCH_UNKNOWN)
+			partial->mismatches = MISMATCH_UNKNOWN;
+		else
+			partial->mismatches += counts[i];
+	}
 
-	/* Seek to start of file. */
-	fseek(file_one->pointer, 0, SEEK_SET);
-	fseek(file_two->pointer, 0, SEEK_SET);
+	partial->done += part;
+	if (partial->done < length) return 0;
 
-	/* Compare bytes of file_one with file_two. Store results in */
-	/* a dynamically-sized block_cache. */
-	for (i = 0; i < total_blocks; i++) {
-		int bytes_read_one, bytes_read_two;
-		size_t bytes_in_block, j;
-
-		/* Calculate how many bytes to read for this block. */
-		if (i < blocks_with_excess_byte) {
-			bytes_in_block = bytes_per_block + 1;
-		} else {
-			bytes_in_block = bytes_per_block;
-		}
+	block_cache[block] = partial->state;
+	mismatch_counts[block] = partial->mismatches;
+	partial->done = 0;
+	partial->state = BLOCK_EMPTY;
+	partial->mismatches = 0;
+	return 1;
+}
 
-		/* Set the default. */
-		block_cache[i] = BLOCK_SAME;
+/* The first block still to verify: sampled, or left unverified by a
+   comparison that failed. total_blocks if there is none. A block verified
+   in part is started over, as the blocks may have changed. */
+static int first_unverified(char *block_cache, int total_blocks,
+                            struct partial_block *partial)
+{
+	int i;
 
-		/* Clear the block of data. */
-		memset(block_one, '\0', bytes_in_block);
-		memset(block_two, '\0', bytes_in_block);
+	partial->done = 0;
+	partial->state = BLOCK_EMPTY;
+	partial->mismatches = 0;
 
-		/* Read in the next block of data. */
-		bytes_read_one = fread(block_one, bytes_in_block,
-		                           1, file_one->pointer);
-		bytes_read_two = fread(block_two, bytes_in_block,
-		                           1, file_two->pointer);
+	if (block_cache == NULL) return total_blocks;
+	for (i = 0; i < total_blocks; i++)
+		if (block_cache[i] & BLOCK_SAMPLED) break;
+	return i;
+}
 
-		/* Stop here if we read 0 bytes. Both files are fully read. */
-		if (bytes_read_one == 0 && bytes_read_two == 0) {
-			block_cache[i] = BLOCK_EMPTY;
-			break;
-		}
+/* Percentage of blocks verified so far, or -1 once all of them are. */
+static int verify_progress(int next_unverified, int total_blocks)
+{
+	if (next_unverified >= total_blocks) return -1;
+	return (int) ((double) next_unverified * 100 / total_blocks);
+}
 
-		/* If the file lengths don't match up, we know the blocks are
-		   different. Go to the next block. */
-		if (bytes_read_one != bytes_read_two) {
-			block_cache[i] = BLOCK_DIFFERENT;
-			continue;
-		}
+/* Comparisons only count the byte statistics of the blocks they read.
+   The others cost a read of their own, so they are only counted while a
+   layer shows them, and then once: 'stats_ready' tells that they are. */
+static void complete_stats(struct hexcompare *engine, int layer,
+                           char *block_cache,
+                           struct hexcompare_stats *block_stats,
+                           int total_blocks, int *stats_ready)
+{
+	if (layer != LAYER_STATS_ONE && layer != LAYER_STATS_TWO) return;
+	if (*stats_ready) return;
+	*stats_ready = hexcompare_block_stats(engine, 0, total_blocks,
+	                                      total_blocks, block_cache,
+	                                      block_stats) == 0;
+}
 
-		/* Both blocks have the same length. Compare them character by
-		   character. */
-		for (j = 0; j < bytes_in_block; j++) {
-			if (block_one[j] != block_two[j]) {
-				block_cache[i] = BLOCK_DIFFERENT;
-				break;
-			}
-		}
+static char *generate_blocks(struct hexcompare *engine, char *block_cache,
+                             unsigned long **mismatch_counts,
+                             struct hexcompare_stats **block_stats,
+                             int total_blocks, int progressive)
+{
+	/* Give back the memory that holds the block data. Unless the number
+	   of blocks changed a lot, the same buffers come back from the
+	   arena, so resizing and rescanning don't allocate. */
+	hexcompare_free(block_cache);
+	hexcompare_free(*mismatch_counts);
+	hexcompare_free(*block_stats);
+
+	/* Get the correct amount of memory and initialize it. Without it,
+	   return NULL and hold nothing. */
+	block_cache = hexcompare_alloc(total_blocks);
+	*mismatch_counts = hexcompare_alloc(total_blocks *
+	                                    sizeof(unsigned long));
+	*block_stats = hexcompare_alloc(total_blocks * 2 *
+	                                sizeof(struct hexcompare_stats));
+	if (block_cache == NULL || *mismatch_counts == NULL ||
+	    *block_stats == NULL) {
+		hexcompare_free(block_cache);
+		hexcompare_free(*mismatch_counts);
+		hexcompare_free(*block_stats);
+		*mismatch_counts = NULL;
+		*block_stats = NULL;
+		return NULL;
 	}
+	memset(block_cache, BLOCK_EMPTY, total_blocks);
+	memset(*mismatch_counts, 0, total_blocks * sizeof(unsigned long));
+	memset(*block_stats, 0, total_blocks * 2 *
+	       sizeof(struct hexcompare_stats));
 
-	/* free memory */
-	free(block_one);
-	free(block_two);
+	/* Compare bytes of file_one with file_two on all threads. Store
+	   results in a dynamically-sized block_cache. In progressive mode,
+	   only sample the blocks; start_gui() verifies them later. */
+	hexcompare_blocks(engine, 0, total_blocks, total_blocks, block_cache,
+	                  *mismatch_counts, *block_stats, progressive);
 
 	return block_cache;
 }
@@ -278,12 +437,11 @@ static unsigned long *generate_offsets(unsigned long *offset_index,
 	int i;
 	unsigned long offset = 0;
 
-	/* De-allocate existing memory that holds the offset data. */
-	if (offset_index != NULL) free(offset_index);
-
-	/* Allocate the correct amount of memory and initialize it. */
-	offset_index = malloc(total_blocks * sizeof(unsigned long));
-	memset(offset_index, 0, total_blocks);
+	/* Swap the memory that holds the offset data for the correct amount,
+	   as for the block data. Every entry is set below. */
+	hexcompare_free(offset_index);
+	offset_index = hexcompare_alloc(total_blocks * sizeof(unsigned long));
+	if (offset_index == NULL) return NULL;
 
 	/* Generate offset data. */
 	for (i = 0; i < total_blocks; i++) {
@@ -301,7 +459,8 @@ static unsigned long *generate_offsets(unsigned long *offset_index,
 static unsigned long calculate_offset(unsigned long file_offset,
                                       unsigned long *offset_index, int width,
                                       int total_blocks, int shift_type,
-                                      unsigned long largest_file_size)
+                                      unsigned long largest_file_size,
+                                      struct hexcompare *engine)
 {
 
 	/* Initialize variables. */
@@ -310,7 +469,8 @@ static unsigned long calculate_offset(unsigned long file_offset,
 	int current_block = 0;
 
 	/* Calculate parameters for the offset. */
-	int offset_char_size = calculate_max_offset_characters(largest_file_size);
+	int offset_char_size = calculate_offset_margin(engine,
+	                                               largest_file_size);
 	int hex_width = width - offset_char_size - 3 - SIDE_MARGIN * 2;
 	int offset_jump = (hex_width - (hex_width % 4)) / 4;
 
@@ -363,8 +523,8 @@ static unsigned long calculate_offset(unsigned long file_offset,
  * that basename() would be appropriate here, but the problem is that
  * some platforms have a basename() that modifies the passed string,
  * which we want to avoid. */
-static char *getfilename(char *f) {
-	char *res = f;
+static const char *getfilename(const char *f) {
+	const char *res = f;
 	for (; *f != 0; f += 1) {
 		if ((*f == '/') || (*f == '\\')) {
 			res = f + 1;
@@ -377,15 +537,14 @@ static char *getfilename(char *f) {
    ##           DRAW ROWS OF RAW DATA IN HEX/ASCII FORM               ##
    ##################################################################### */
 
-static void display_file_names(int row, struct file *file_one,
-                               struct file *file_two, int offset_char_size,
-                               int offset_jump)
+static void display_file_names(int row, struct hexcompare *engine,
+                               int offset_char_size, int offset_jump)
 {
-	char *filename_one, *filename_two;
+	const char *filename_one, *filename_two;
 
 	/* ltrim the filenames if any / character is found */
-	filename_one = getfilename(file_one->name);
-	filename_two = getfilename(file_two->name);
+	filename_one = getfilename(hexcompare_name(engine, 0));
+	filename_two = getfilename(hexcompare_name(engine, 1));
 
 	/* Display the file names. */
 	attron(COLOR_PAIR(TITLE_BAR));
@@ -397,46 +556,65 @@ static void display_file_names(int row, struct file *file_one,
 }
 
 static void display_offsets(int start_row, int finish_row, int offset_jump,
-                            int offset_char_size, unsigned long file_offset)
+                            int offset_char_size, unsigned long file_offset,
+                            struct hexcompare *engine)
 {
 	int i;
-	char offset_line[32];
+	char offset_line[48];
 	unsigned long temp_offset = file_offset;
 
 	attron(COLOR_PAIR(TITLE_BAR));
 	for (i = start_row; i < finish_row; i++) {
-		sprintf(offset_line, "0x%%0%ix ", offset_char_size);
-		mvprintw(i, SIDE_MARGIN, offset_line, temp_offset);
+		if (calculate_two_offsets(engine)) {
+			/* Both offsets, side by side. */
+			sprintf(offset_line, "0x%%0%ilx 0x%%0%ilx ",
+			        (offset_char_size - 3) / 2, (offset_char_size - 3) / 2);
+			mvprintw(i, SIDE_MARGIN, offset_line,
+			         hexcompare_start(engine, 0) + temp_offset,
+			         hexcompare_start(engine, 1) +
+			         hexcompare_aligned_offset(engine, temp_offset));
+		} else {
+			sprintf(offset_line, "0x%%0%ilx ", offset_char_size);
+			mvprintw(i, SIDE_MARGIN, offset_line,
+			         hexcompare_start(engine, 0) + temp_offset);
+		}
 		temp_offset += offset_jump - 1;
 	}
 	attroff(COLOR_PAIR(TITLE_BAR));
 }
 
-static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
-                          struct file *file_two, unsigned long file_offset,
+static void draw_hex_data(int start_row, int finish_row,
+                          struct hexcompare *engine, unsigned long file_offset,
                           int offset_char_size, int offset_jump, int display)
 {
 
 	unsigned long temp_offset = file_offset;
 	int i, j;
 
+	/* Let the engine see where the view went, to read ahead of it. */
+	hexcompare_view(engine, file_offset,
+	                (unsigned long) (finish_row - start_row) * offset_jump);
+
 	for (i = start_row; i < finish_row; i++) {
 		int bold = 0;
 		for (j = SIDE_MARGIN+offset_char_size+3; j <
 			SIDE_MARGIN+offset_char_size+offset_jump*2+1; j += 2) {
-			int colour_pair;
-			unsigned char byte_one, byte_two;
+			int colour_pair, unknown, masked;
+			unsigned char byte_one = 0, byte_two = 0;
 			char byte_one_hex[16], byte_two_hex[16];
 			char byte_one_ascii, byte_two_ascii;
 			int bytes_read_one, bytes_read_two;
 
-			/* Seek to the proper locations in the file. */
-			fseek(file_one->pointer, temp_offset, SEEK_SET);
-			fseek(file_two->pointer, temp_offset, SEEK_SET);
+			/* Read at the proper locations in the file. */
+			bytes_read_one = hexcompare_read(engine, 0, &byte_one, 1,
+			                                 temp_offset);
 
-			/* Read a byte from the files. */
-			bytes_read_one = fread(&byte_one, 1, 1, file_one->pointer);
-			bytes_read_two = fread(&byte_two, 1, 1, file_two->pointer);
+			/* Read a byte from the files. When only a signature of the
+			   second file is loaded, its bytes are unknown and only the
+			   chunk hashes tell whether they match. */
+			unknown = hexcompare_unknown(engine, temp_offset);
+			bytes_read_two = hexcompare_read(engine, 1, &byte_two, 1,
+			                 hexcompare_aligned_offset(engine, temp_offset));
 
 			/* Convert binary to ASCII hex. */
 			sprintf(byte_one_hex, "%02x", byte_one);
@@ -448,6 +626,10 @@ static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
 			byte_one_ascii = raw_to_ascii(byte_one);
 			byte_two_ascii = raw_to_ascii(byte_two);
 
+			/* Bytes left out by the mask look alike on both sides. */
+			masked = bytes_read_one != 0 && bytes_read_two != 0 &&
+			         hexcompare_masked(engine, temp_offset);
+
 			/* Make every other byte bold. */
 			if (bold != 0) attron(A_BOLD);
 
@@ -457,6 +639,10 @@ static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
 			   Determine if its EMPTY/DIFFERENT/SAME. */
 			if (bytes_read_one == 0) {
 				colour_pair = BLOCK_EMPTY;
+			} else if (masked) {
+				colour_pair = BLOCK_MASKED;
+			} else if (unknown) {
+				colour_pair = unknown;
 			} else if (bytes_read_two == 0) {
 				colour_pair = BLOCK_DIFFERENT;
 			} else if (byte_one == byte_two) {
@@ -478,8 +664,13 @@ static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
 
 			/* Byte 2:
 			   Determine if its EMPTY/DIFFERENT/SAME. */
-			if (bytes_read_two == 0) {
+			if (unknown) {
+				colour_pair = (bytes_read_one == 0) ? BLOCK_DIFFERENT
+				              : unknown;
+			} else if (bytes_read_two == 0) {
 				colour_pair = BLOCK_EMPTY;
+			} else if (masked) {
+				colour_pair = BLOCK_MASKED;
 			} else if (bytes_read_one == 0) {
 				colour_pair = BLOCK_DIFFERENT;
 			} else if (byte_one == byte_two) {
@@ -492,6 +683,9 @@ static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
 			attron(COLOR_PAIR(colour_pair));
 			if (colour_pair == BLOCK_EMPTY) {
 				mvprintw(i,j+offset_jump*2+1, "  ");
+			} else if (unknown) {
+				mvprintw(i,j+offset_jump*2+1, "%s",
+				         display == HEX_VIEW ? " ?" : "??");
 			} else if (display == HEX_VIEW) {
 				mvprintw(i,j+offset_jump*2+1, " %c", byte_two_ascii);
 			} else {
@@ -510,15 +704,100 @@ static void draw_hex_data(int start_row, int finish_row, struct file *file_one,
 	return;
 }
 
+/* #####################################################################
+   ##                   MISMATCH DENSITY HEATMAP                      ##
+   ##################################################################### */
+
+static void init_heat_colours(void)
+{
+	/* With 256 colours, differing blocks fade from pale pink to full red
+	   as more of their bytes differ. Otherwise they stay red, and the
+	   density is drawn as a symbol in the block. */
+	if (COLORS >= 256) {
+		init_pair(BLOCK_HEAT_1, COLOR_BLACK, 224);
+		init_pair(BLOCK_HEAT_2, COLOR_BLACK, 210);
+		init_pair(BLOCK_HEAT_3, COLOR_WHITE, 167);
+	} else {
+		init_pair(BLOCK_HEAT_1, COLOR_WHITE, COLOR_RED);
+		init_pair(BLOCK_HEAT_2, COLOR_WHITE, COLOR_RED);
+		init_pair(BLOCK_HEAT_3, COLOR_WHITE, COLOR_RED);
+	}
+}
+
+/* Pick the colour of a differing block from the share of its bytes that
+   differ: up to 1/64, 1/8, 1/2, or more. */
+static int calculate_heat(unsigned long mismatches, unsigned long length,
+                          char *symbol)
+{
+	if (mismatches == MISMATCH_UNKNOWN || length == 0 ||
+	    mismatches * 2 > length)
+		return BLOCK_DIFFERENT;
+
+	if (COLORS < 256) {
+		if (mismatches * 64 <= length) *symbol = '.';
+		else if (mismatches * 8 <= length) *symbol = ':';
+		else *symbol = '*';
+	}
+
+	if (mismatches * 64 <= length) return BLOCK_HEAT_1;
+	if (mismatches * 8 <= length) return BLOCK_HEAT_2;
+	return BLOCK_HEAT_3;
+}
+
+/* #####################################################################
+   ##                  BYTE STATISTICS PER BLOCK                      ##
+   ##################################################################### */
+
+static void init_stats_colours(void)
+{
+	/* From dark grey for padding and sparse data to purple for data
+	   that looks random, i.e. compressed or encrypted. */
+	if (COLORS >= 256) {
+		init_pair(BLOCK_ENTROPY_1, COLOR_WHITE, 239);
+		init_pair(BLOCK_ENTROPY_2, COLOR_BLACK, 114);
+		init_pair(BLOCK_ENTROPY_3, COLOR_BLACK, 221);
+		init_pair(BLOCK_ENTROPY_4, COLOR_WHITE, 97);
+	} else {
+		init_pair(BLOCK_ENTROPY_1, COLOR_WHITE, COLOR_BLACK);
+		init_pair(BLOCK_ENTROPY_2, COLOR_BLACK, COLOR_GREEN);
+		init_pair(BLOCK_ENTROPY_3, COLOR_BLACK, COLOR_YELLOW);
+		init_pair(BLOCK_ENTROPY_4, COLOR_WHITE, COLOR_MAGENTA);
+	}
+}
+
+/* Pick the colour of a block in a statistics layer from its entropy.
+   Blocks that are nearly all zeros show "0", nearly all some other byte
+   "=", and random-looking ones "#". Blocks not counted show "?". */
+static int calculate_texture(struct hexcompare_stats *stats, int has_data,
+                             char *symbol)
+{
+	if (stats->length == 0) {
+		*symbol = has_data ? '?' : ' ';
+		return BLOCK_EMPTY;
+	}
+
+	if (stats->zeros * 16 >= 15) *symbol = '0';
+	else if (stats->common_share * 16 >= 15) *symbol = '=';
+	else if (stats->entropy >= 7.5) *symbol = '#';
+
+	if (stats->entropy < 2) return BLOCK_ENTROPY_1;
+	if (stats->entropy < 5) return BLOCK_ENTROPY_2;
+	if (stats->entropy < 7.5) return BLOCK_ENTROPY_3;
+	return BLOCK_ENTROPY_4;
+}
+
 /* #####################################################################
    ##              GENERATE SCREEN IN OVERVIEW MODE                   ##
    ##################################################################### */
 
-static void generate_overview(struct file *file_one, struct file *file_two,
+static void generate_overview(struct hexcompare *engine,
                               unsigned long *file_offset, int width,
-                              int height, char *block_cache, int total_blocks,
+                              int height, char *block_cache,
+                              unsigned long *mismatch_counts,
+                              struct hexcompare_stats *block_stats,
+                              int total_blocks,
                               unsigned long *offset_index, int display,
-                              unsigned long largest_file_size)
+                              unsigned long largest_file_size, int layer)
 {
 
 	/* In overview mode:
@@ -553,6 +832,11 @@ static void generate_overview(struct file *file_one, struct file *file_two,
 	init_pair(BLOCK_EMPTY,     COLOR_BLACK, COLOR_CYAN);
 	init_pair(BLOCK_ACTIVE,    COLOR_BLACK, COLOR_YELLOW);
 	init_pair(TITLE_BAR,       COLOR_BLACK, COLOR_WHITE);
+	init_pair(BLOCK_SHIFTED,   COLOR_WHITE, COLOR_MAGENTA);
+	init_pair(BLOCK_MATCH,     COLOR_BLACK, COLOR_GREEN);
+	init_pair(BLOCK_MASKED,    COLOR_BLACK, COLOR_WHITE);
+	init_heat_colours();
+	init_stats_colours();
 
 	/* Find which block in the diagram is active based off of
 	   the current offset. */
@@ -563,9 +847,42 @@ static void generate_overview(struct file *file_one, struct file *file_two,
 
 			/* Draw the blocks that are matching/different/empty. */
 			int index = i*(width-SIDE_MARGIN*2)+j;
-			attron(COLOR_PAIR(block_cache[index]));
-			mvprintw(i+2,j+SIDE_MARGIN," ");
-			attroff(COLOR_PAIR(block_cache[index]));
+			int colour_pair = block_cache[index] & ~BLOCK_SAMPLED;
+			char symbol = (block_cache[index] & BLOCK_SAMPLED) ? '?' : ' ';
+			unsigned long end = (index + 1 < total_blocks) ?
+			                    offset_index[index + 1] : largest_file_size;
+
+			/* Grade differing blocks by how much of them differs. */
+			if (colour_pair == BLOCK_DIFFERENT && index < total_blocks)
+				colour_pair = calculate_heat(mismatch_counts[index],
+				              end - offset_index[index], &symbol);
+
+			/* In the search layer, blocks holding matches are green and
+			   show how many there are. */
+			if (layer == LAYER_MATCHES && index < total_blocks) {
+				unsigned long count = hexcompare_search_count(engine,
+				                      offset_index[index],
+				                      end - offset_index[index]);
+				if (count > 0) {
+					colour_pair = BLOCK_MATCH;
+					symbol = count > 9 ? '+' : '0' + count;
+				}
+			}
+
+			/* In a statistics layer, blocks show what kind of bytes
+			   one of the files holds there. */
+			if ((layer == LAYER_STATS_ONE || layer == LAYER_STATS_TWO) &&
+			    index < total_blocks) {
+				int side = (layer == LAYER_STATS_TWO);
+				symbol = ' ';
+				colour_pair = calculate_texture(&block_stats[index * 2 +
+				              side], offset_index[index] <
+				              hexcompare_file_size(engine, side), &symbol);
+			}
+
+			attron(COLOR_PAIR(colour_pair));
+			mvprintw(i+2,j+SIDE_MARGIN,"%c",symbol);
+			attroff(COLOR_PAIR(colour_pair));
 		}
 	}
 
@@ -578,23 +895,22 @@ static void generate_overview(struct file *file_one, struct file *file_two,
 
 	/* Generate the offset markers.
 	   Calculate parameters for the offset. */
-	offset_char_size = calculate_max_offset_characters(largest_file_size);
+	offset_char_size = calculate_offset_margin(engine, largest_file_size);
 	hex_width = width - offset_char_size - 3 - SIDE_MARGIN * 2;
 	offset_jump = (hex_width - (hex_width % 4)) / 4;
 
 	/* Display the offsets.
 	   Display the hex offsets on the left. */
 	display_offsets(height-7, height-2, offset_jump, offset_char_size,
-	                *file_offset);
+	                *file_offset, engine);
 
 	/* Generate HEX characters
 	   Seek to initial offset. */
-	draw_hex_data(height - 7, height - 2, file_one, file_two,
+	draw_hex_data(height - 7, height - 2, engine,
 	              *file_offset, offset_char_size, offset_jump, display);
 
 	/* Write the file titles. */
-	display_file_names(height-8, file_one, file_two, offset_char_size,
-	                   offset_jump);
+	display_file_names(height-8, engine, offset_char_size, offset_jump);
 
 	return;
 }
@@ -603,7 +919,7 @@ static void generate_overview(struct file *file_one, struct file *file_two,
    ##                 GENERATE SCREEN IN HEX MODE                     ##
    ##################################################################### */
 
-static void generate_hex(struct file *file_one, struct file *file_two,
+static void generate_hex(struct hexcompare *engine,
                          unsigned long *file_offset, int width, int height,
                          int display, unsigned long largest_file_size)
 {
@@ -624,7 +940,8 @@ static void generate_hex(struct file *file_one, struct file *file_two,
 
 	/* Generate the offset markers.
 	   Calculate parameters for the offset. */
-	int offset_char_size = calculate_max_offset_characters(largest_file_size);
+	int offset_char_size = calculate_offset_margin(engine,
+	                                               largest_file_size);
 	int hex_width = width - offset_char_size - 3 - SIDE_MARGIN * 2;
 	int offset_jump = (hex_width - (hex_width % 4)) / 4;
 
@@ -634,20 +951,21 @@ static void generate_hex(struct file *file_one, struct file *file_two,
 	init_pair(BLOCK_EMPTY,     COLOR_BLACK, COLOR_CYAN);
 	init_pair(BLOCK_ACTIVE,    COLOR_BLACK, COLOR_YELLOW);
 	init_pair(TITLE_BAR,       COLOR_BLACK, COLOR_WHITE);
+	init_pair(BLOCK_SHIFTED,   COLOR_WHITE, COLOR_MAGENTA);
+	init_pair(BLOCK_MASKED,    COLOR_BLACK, COLOR_WHITE);
 
 	/* Display the hex offsets on the left. */
 	display_offsets(3, height-2, offset_jump, offset_char_size,
-	                *file_offset);
+	                *file_offset, engine);
 
 	/* Generate HEX characters
 	   Seek to initial offset. */
-	draw_hex_data(3, height - 2, file_one, file_two,
+	draw_hex_data(3, height - 2, engine,
 	              *file_offset, offset_char_size, offset_jump, display);
 
 
 	/* Write the file titles. */
-	display_file_names(2, file_one, file_two, offset_char_size,
-	                   offset_jump);
+	display_file_names(2, engine, offset_char_size, offset_jump);
 
 	return;
 }
@@ -656,27 +974,39 @@ static void generate_hex(struct file *file_one, struct file *file_two,
    ##                    GENERATE SCREEN VIEW                         ##
    ##################################################################### */
 
-static void generate_screen(struct file *file_one, struct file *file_two,
+static void generate_screen(struct hexcompare *engine,
                             char mode, unsigned long *file_offset, int width,
-                            int height, char *block_cache, int total_blocks,
+                            int height, char *block_cache,
+                            unsigned long *mismatch_counts,
+                            struct hexcompare_stats *block_stats,
+                            int total_blocks,
                             unsigned long *offset_index, int display,
-                            unsigned long largest_file_size)
+                            unsigned long largest_file_size, int layer,
+                            int progress)
 {
+	struct hexcompare_stats *stats = NULL;
+
 	/* Clear the window. */
 	erase();
 
-	/* Generate the title bar. */
-	generate_titlebar(file_one, file_two, *file_offset, width, height,
-		          mode, display);
+	/* Generate the title bar, with the statistics of the current block
+	   in a statistics layer. */
+	if (layer == LAYER_STATS_ONE || layer == LAYER_STATS_TWO)
+		stats = &block_stats[calculate_current_block(total_blocks,
+		        *file_offset, offset_index) * 2 +
+		        (layer == LAYER_STATS_TWO)];
+	generate_titlebar(engine, *file_offset, width, height,
+		          mode, display, progress, stats, layer);
 
 	/* Generate the window contents according to the mode we're in. */
 	if (mode == OVERVIEW_MODE) {
-		generate_overview(file_one, file_two, file_offset,
-		                  width, height, block_cache, total_blocks,
-		                  offset_index, display, largest_file_size);
+		generate_overview(engine, file_offset,
+		                  width, height, block_cache, mismatch_counts,
+		                  block_stats, total_blocks,
+		                  offset_index, display, largest_file_size, layer);
 
 	} else if (mode == HEX_MODE) {
-		generate_hex(file_one, file_two, file_offset, width, height,
+		generate_hex(engine, file_offset, width, height,
 		             display, largest_file_size);
 	}
 }
@@ -685,28 +1015,57 @@ static void generate_screen(struct file *file_one, struct file *file_two,
    ##                       MAIN FUNCTION                             ##
    ##################################################################### */
 
-void start_gui(struct file *file_one, struct file *file_two,
-               unsigned long largest_file_size)
+int start_gui(struct hexcompare *engine, int progressive)
 {
 	/* Initiate variables */
 	unsigned long file_offset = 0;      /* File offset. */
 	char mode = OVERVIEW_MODE;          /* Display mode. */
 	int key_pressed;                    /* What key is pressed. */
 	char *block_cache = NULL;           /* A quick comparison overview. */
+	unsigned long *mismatch_counts = NULL; /* Differing bytes per block. */
+	struct hexcompare_stats *block_stats = NULL; /* Bytes of both files. */
+	int stats_ready = 0;                /* block_stats cover all blocks. */
 	unsigned long *offset_index = NULL; /* Keep track of offsets per block. */
 	int display = HEX_VIEW;             /* ASCII vs. HEX mode. */
 	MEVENT mouse;                       /* Mouse event struct. */
 	WINDOW *main_window;                /* Pointer for main window. */
+	int searched = 0;                   /* A search found matches. */
+	int layer = LAYER_DIFF;             /* What the overview shows. */
+	char pattern[HEXCOMPARE_MAX_PATTERN*3]; /* Search pattern as typed. */
+	int next_unverified;                /* First block still sampled. */
+	int stalled = 0;                    /* Verifying failed, wait for a key. */
+	struct partial_block partial;       /* Large block verified in part. */
+	int watching;                       /* Follow changes to the files. */
+	int reading_ahead = 0;              /* Pages ahead may be missing. */
+	int failed;                         /* No memory for the caches. */
+	unsigned long largest_file_size;    /* Size of the larger file. */
+#ifndef __DJGPP__
+	FILE *terminal = NULL;              /* Keyboard when stdin is data. */
+	SCREEN *screen = NULL;              /* Screen on that terminal. */
+#endif
 
 	int width, height, total_blocks, blocks_with_excess_byte;
 	unsigned long bytes_per_block;
 
-	/* Initiate the display. */
-	main_window = initscr(); /* Start curses mode. */
+	largest_file_size = hexcompare_size(engine);
+	watching = (hexcompare_flags(engine) & HEXCOMPARE_WATCHED) != 0;
+
+	/* Initiate the display. When a file is piped in on stdin, keys have
+	   to be read from the terminal instead. */
+	main_window = NULL;
+#ifndef __DJGPP__
+	if (!isatty(fileno(stdin)) &&
+	    (terminal = fopen("/dev/tty", "r")) != NULL) {
+		if ((screen = newterm(NULL, stdout, terminal)) != NULL)
+			main_window = stdscr;
+	}
+#endif
+	if (main_window == NULL)
+		main_window = initscr(); /* Start curses mode. */
 	if (has_colors() != TRUE) {
 		puts("Error: Your terminal do not seem to handle colors.");
 		endwin();
-		return;
+		return -1;
 	}
 	start_color();           /* Enable the use of colours. */
 	raw();                   /* Disable line buffering. */
@@ -727,21 +1086,107 @@ void start_gui(struct file *file_one, struct file *file_two,
 	   the offsets are for each block in the block diagram, as they
 	   may be uneven. */
 
-	block_cache = generate_blocks(file_one, file_two, block_cache,
-	                              total_blocks, bytes_per_block,
-	                              blocks_with_excess_byte);
+	/* Progressive mode first samples every block for a quick overview,
+	   then verifies them in the background while waiting for keys. The
+	   alignment and remote overviews don't read blocks to begin with. */
+	if (hexcompare_flags(engine) & (HEXCOMPARE_ALIGNED | HEXCOMPARE_REMOTE))
+		progressive = 0;
+
+	block_cache = generate_blocks(engine, block_cache, &mismatch_counts,
+	                              &block_stats, total_blocks, progressive);
+	next_unverified = first_unverified(block_cache, total_blocks,
+	                                   &partial);
 	offset_index = generate_offsets(offset_index, total_blocks,
 	                          bytes_per_block, blocks_with_excess_byte);
 
-	/* Generate initial screen contents. */
-	generate_screen(file_one, file_two, mode, &file_offset, width, height,
-	                block_cache, total_blocks, offset_index, display,
-                        largest_file_size);
+	/* Generate initial screen contents, unless there was no memory for
+	   the caches. */
+	failed = block_cache == NULL || offset_index == NULL;
+	if (!failed)
+		generate_screen(engine, mode, &file_offset, width, height,
+		                block_cache, mismatch_counts, block_stats,
+		                total_blocks, offset_index,
+		                display, largest_file_size, layer,
+		                verify_progress(next_unverified, total_blocks));
+	reading_ahead = 1;
 
 	/* Wait for user-keypresses and react accordingly. */
-	for(;;) {
-		/* poll the next keypress event from curses */
+	while (!failed) {
+		/* poll the next keypress event from curses. While blocks are
+		   left to verify or pages to read ahead, don't wait for it;
+		   while watching the files, don't wait for long. */
+		timeout((next_unverified < total_blocks && !stalled) ||
+		        reading_ahead ? 0 :
+		        watching ? HEXCOMPARE_POLL_INTERVAL : -1);
 		key_pressed = wgetch(main_window);
+		if (key_pressed != ERR) stalled = 0;
+
+		/* No key yet: verify the next batch of sampled blocks. Blocks
+		   that fail stay flagged, and are tried again after a key, so
+		   that running out of memory doesn't spin. */
+		if (key_pressed == ERR && next_unverified < total_blocks &&
+		    !stalled && verify_in_parts(bytes_per_block)) {
+			/* Blocks too large for a batch: a part of one at a time.
+			   Its statistics are left for complete_stats(). */
+			int result = verify_part(engine, next_unverified,
+			                         total_blocks, &partial,
+			                         block_cache, mismatch_counts);
+			if (result < 0) stalled = 1;
+			if (result > 0) next_unverified++;
+			stats_ready = 0;
+		} else if (key_pressed == ERR &&
+		           next_unverified < total_blocks && !stalled) {
+			int count = verify_batch(next_unverified, total_blocks,
+			                         bytes_per_block);
+			if (hexcompare_blocks(engine, next_unverified, count,
+			                      total_blocks, block_cache,
+			                      mismatch_counts, block_stats, 0) != 0) {
+				next_unverified = first_unverified(block_cache,
+				                  total_blocks, &partial);
+				stalled = 1;
+			} else {
+				next_unverified += count;
+			}
+			stats_ready = 0;
+		} else if (key_pressed == ERR && reading_ahead) {
+			/* Or read ahead of the hex view; the screen stays. */
+			reading_ahead = hexcompare_read_ahead(engine);
+			continue;
+		} else if (key_pressed == ERR) {
+			unsigned long new_size;
+
+			/* Or look for changes to the files. */
+			if (!watching || hexcompare_poll(engine) == 0) continue;
+
+			new_size = hexcompare_size(engine);
+			if (new_size == largest_file_size) {
+				/* Same layout: only compare the changed blocks,
+				   which may include one verified in part. */
+				hexcompare_refresh(engine, total_blocks,
+				                   block_cache, mismatch_counts,
+				                   block_stats);
+				next_unverified = first_unverified(block_cache,
+				                  total_blocks, &partial);
+				stats_ready = 0;
+			} else {
+				/* The blocks moved: lay them out again. Only chunks
+				   that hash differently are read. */
+				largest_file_size = new_size;
+				calculate_dimensions(&width, &height, &total_blocks,
+				                     &bytes_per_block, largest_file_size,
+				                     &blocks_with_excess_byte);
+				block_cache = generate_blocks(engine, block_cache,
+				              &mismatch_counts, &block_stats,
+				              total_blocks, 0);
+				next_unverified = first_unverified(block_cache,
+				                  total_blocks, &partial);
+				stats_ready = 0;
+				offset_index = generate_offsets(offset_index,
+				               total_blocks, bytes_per_block,
+				               blocks_with_excess_byte);
+				if (file_offset >= largest_file_size) file_offset = 0;
+			}
+		}
 
 		/* if we got 'q' or ESC, then quit */
 		if ((key_pressed == 'q') || (key_pressed == 27)) break;
@@ -754,43 +1199,51 @@ void start_gui(struct file *file_one, struct file *file_two,
 				if (mode == OVERVIEW_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              LEFT_BLOCK, largest_file_size);
+				              LEFT_BLOCK, largest_file_size,
+				              engine);
 				break;
 			case KEY_RIGHT:
 				if (mode == OVERVIEW_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              RIGHT_BLOCK, largest_file_size);
+				              RIGHT_BLOCK, largest_file_size,
+				              engine);
 				break;
 			case KEY_UP:
 				if (mode == OVERVIEW_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              UP_ROW, largest_file_size);
+				              UP_ROW, largest_file_size,
+				              engine);
 				else if (mode == HEX_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              UP_LINE, largest_file_size);
+				              UP_LINE, largest_file_size,
+				              engine);
 				break;
 			case KEY_DOWN:
 				if (mode == OVERVIEW_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              DOWN_ROW, largest_file_size);
+				              DOWN_ROW, largest_file_size,
+				              engine);
 				else if (mode == HEX_MODE)
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              DOWN_LINE, largest_file_size);
+				              DOWN_LINE, largest_file_size,
+				              engine);
 				break;
 			case KEY_NPAGE:
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              DOWN_LINE, largest_file_size);
+				              DOWN_LINE, largest_file_size,
+				              engine);
 				break;
 			case KEY_PPAGE:
 				file_offset = calculate_offset(file_offset,
 				              offset_index, width, total_blocks,
-				              UP_LINE, largest_file_size);
+				              UP_LINE, largest_file_size,
+				              engine);
 				break;
 			case 'm':
 				if (display == ASCII_VIEW) display = HEX_VIEW;
@@ -800,6 +1253,47 @@ void start_gui(struct file *file_one, struct file *file_two,
 				if (mode == OVERVIEW_MODE) mode = HEX_MODE;
 				else mode = OVERVIEW_MODE;
 				break;
+
+			/* Search both files, then jump to the first match at or
+			   after the current offset. */
+			case '/':
+				if (prompt(width, height, "Find (text, or 0x and hex "
+				           "bytes): ", pattern, sizeof(pattern)) == 0)
+					break;
+				searched = hexcompare_search(engine, pattern) >= 0;
+				if (!searched ||
+				    (hexcompare_search_next(engine, file_offset, 0,
+				                            &file_offset) != 0 &&
+				     hexcompare_search_next(engine, file_offset, -1,
+				                            &file_offset) != 0))
+					beep();
+				else
+					layer = LAYER_MATCHES;
+				break;
+			case 'n':
+				if (hexcompare_search_next(engine, file_offset, 1,
+				                           &file_offset) != 0)
+					beep();
+				break;
+			case 'N':
+				if (hexcompare_search_next(engine, file_offset, -1,
+				                           &file_offset) != 0)
+					beep();
+				break;
+			case 'l':
+				if (layer == LAYER_DIFF && searched)
+					layer = LAYER_MATCHES;
+				else
+					layer = LAYER_DIFF;
+				break;
+			case 'e':
+				if (layer == LAYER_STATS_ONE)
+					layer = LAYER_STATS_TWO;
+				else if (layer == LAYER_STATS_TWO)
+					layer = LAYER_DIFF;
+				else
+					layer = LAYER_STATS_ONE;
+				break;
 			case KEY_MOUSE:
 				if (nc_getmouse(&mouse) == OK) {
 
@@ -825,24 +1319,46 @@ void start_gui(struct file *file_one, struct file *file_two,
 				calculate_dimensions(&width, &height, &total_blocks,
 	                               &bytes_per_block, largest_file_size,
 	                               &blocks_with_excess_byte);
-				block_cache = generate_blocks(file_one, file_two,
-				            block_cache, total_blocks, bytes_per_block,
-				            blocks_with_excess_byte);
+				block_cache = generate_blocks(engine, block_cache,
+				              &mismatch_counts, &block_stats,
+				              total_blocks, progressive);
+				next_unverified = first_unverified(block_cache,
+				                  total_blocks, &partial);
+				stats_ready = 0;
 				offset_index = generate_offsets(offset_index,
 				               total_blocks, bytes_per_block,
 				               blocks_with_excess_byte);
 				break;
 		}
 
-		generate_screen(file_one, file_two, mode, &file_offset, width,
-	                        height, block_cache, total_blocks,
-                                offset_index, display, largest_file_size);
+		/* The caches may have been made again, without memory. */
+		if (block_cache == NULL || offset_index == NULL) {
+			failed = 1;
+			break;
+		}
+
+		complete_stats(engine, layer, block_cache, block_stats,
+		               total_blocks, &stats_ready);
+		generate_screen(engine, mode, &file_offset, width,
+	                        height, block_cache, mismatch_counts,
+	                        block_stats, total_blocks, offset_index, display,
+	                        largest_file_size, layer,
+	                        verify_progress(next_unverified, total_blocks));
+		reading_ahead = 1;
 	}
 
 	/* End curses mode and exit. */
 	clear();
 	refresh();
 	endwin();
-	free(block_cache);
-	return;
+#ifndef __DJGPP__
+	if (screen != NULL) delscreen(screen);
+	if (terminal != NULL) fclose(terminal);
+#endif
+	if (failed) puts("Error: Not enough memory for the overview.");
+	hexcompare_free(block_cache);
+	hexcompare_free(mismatch_counts);
+	hexcompare_free(block_stats);
+	hexcompare_free(offset_index);
+	return failed ? -1 : 0;
 }
@@ -19,7 +19,7 @@
 #include <curses.h>
 #include <stdlib.h>
 #include <string.h>
-#include "general.h"
+#include "hexcompare.h"
 
 #define OVERVIEW_MODE 0
 #define HEX_MODE 1
@@ -27,11 +27,34 @@
 #define HEX_VIEW 0
 #define ASCII_VIEW 1
 
-#define BLOCK_SAME 1            /* Blue Box */
-#define BLOCK_DIFFERENT 2       /* Red Box */
-#define BLOCK_EMPTY 3           /* Grey Box */
+/* Block states from the engine double as colour pairs. */
+#define BLOCK_SAME HEXCOMPARE_SAME             /* Blue Box */
+#define BLOCK_DIFFERENT HEXCOMPARE_DIFFERENT   /* Red Box */
+#define BLOCK_EMPTY HEXCOMPARE_EMPTY           /* Grey Box */
 #define BLOCK_ACTIVE 4          /* Green Box */
 #define TITLE_BAR 5             /* Black text on White Background */
+#define BLOCK_SHIFTED HEXCOMPARE_SHIFTED /* Magenta Box, found elsewhere */
+#define BLOCK_MATCH 7           /* Green Box, holds search matches */
+#define BLOCK_HEAT_1 8          /* Pale Red Box, a few bytes differ */
+#define BLOCK_HEAT_2 9          /* Light Red Box, up to 1/8 differs */
+#define BLOCK_HEAT_3 10         /* Dark Pink Box, up to 1/2 differs */
+#define BLOCK_ENTROPY_1 11      /* Dark Grey Box, under 2 bits per byte */
+#define BLOCK_ENTROPY_2 12      /* Green Box, under 5 bits per byte */
+#define BLOCK_ENTROPY_3 13      /* Yellow Box, under 7.5 bits per byte */
+#define BLOCK_ENTROPY_4 14      /* Purple Box, looks random */
+#define BLOCK_MASKED 15         /* White Box, ignored by the mask */
+
+#define BLOCK_SAMPLED HEXCOMPARE_SAMPLED      /* Not verified yet */
+
+#define MISMATCH_UNKNOWN HEXCOMPARE_UNKNOWN    /* Not counted per byte */
+
+#define VERIFY_BATCH 67108864   /* Bytes verified between key presses */
+#define VERIFY_PIECES 64        /* Most pieces a part of a block is cut in */
+
+#define LAYER_DIFF 0            /* Overview shows same/different */
+#define LAYER_MATCHES 1         /* Overview shows search matches */
+#define LAYER_STATS_ONE 2       /* Overview shows bytes of file one */
+#define LAYER_STATS_TWO 3       /* Overview shows bytes of file two */
 
 #define SIDE_MARGIN 2           /* Width of the side margins in chars */
 #define VERTICAL_BLACK_SPACE 11 /* Sum of padding from top to bottom */
@@ -48,7 +71,8 @@
 #define nc_getmouse getmouse
 #endif
 
-void start_gui(struct file *file_one, struct file *file_two,
-               unsigned long largest_file_size);
+/* Show the files of the engine, which stays the caller's. Returns 0, or
+   -1 if the terminal can't show them or there is no memory to. */
+int start_gui(struct hexcompare *engine, int progressive);
 
 #endif
@@ -0,0 +1,126 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "hash.h"
+
+#define PRIME64_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME64_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME64_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME64_5 UINT64_C(0x27D4EB2F165667C5)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* Read little-endian values regardless of host byte order, so that a
+   signature written on one machine can be checked on another. */
+static uint64_t read64(const unsigned char *p)
+{
+	return  (uint64_t) p[0]        | ((uint64_t) p[1] << 8)  |
+	       ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+	       ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+	       ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+static uint64_t read32(const unsigned char *p)
+{
+	return  (uint64_t) p[0]        | ((uint64_t) p[1] << 8) |
+	       ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24);
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc  = ROTL64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t merge64(uint64_t acc, uint64_t value)
+{
+	acc ^= round64(0, value);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const void *data, size_t length, uint64_t seed)
+{
+	const unsigned char *p = data;
+	const unsigned char *end = p + length;
+	uint64_t h;
+
+	/* Bulk of the data: four independent lanes of 8 bytes each. */
+	if (length >= 32) {
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+
+		do {
+			v1 = round64(v1, read64(p));      p += 8;
+			v2 = round64(v2, read64(p));      p += 8;
+			v3 = round64(v3, read64(p));      p += 8;
+			v4 = round64(v4, read64(p));      p += 8;
+		} while (p <= limit);
+
+		h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) +
+		    ROTL64(v4, 18);
+		h = merge64(h, v1);
+		h = merge64(h, v2);
+		h = merge64(h, v3);
+		h = merge64(h, v4);
+	} else {
+		h = seed + PRIME64_5;
+	}
+
+	h += (uint64_t) length;
+
+	/* Tail: whatever is left over after the lanes. */
+	while (p + 8 <= end) {
+		h ^= round64(0, read64(p));
+		h  = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= read32(p) * PRIME64_1;
+		h  = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME64_5;
+		h  = ROTL64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	/* Final avalanche. */
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+void hash_store(unsigned char *bytes, uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) bytes[i] = (unsigned char) (value >> (i * 8));
+}
+
+uint64_t hash_load(const unsigned char *bytes)
+{
+	return read64(bytes);
+}
@@ -0,0 +1,32 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_HASH
+#define HEX_HASH
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 64-bit XXH64 hash of a buffer. Used for the per-chunk hashes in block
+   signatures, so the output must stay stable across builds. */
+uint64_t hash64(const void *data, size_t length, uint64_t seed);
+
+/* Store and load a 64-bit value as 8 little-endian bytes, the byte order
+   used by signature files and the remote protocol. */
+void hash_store(unsigned char *bytes, uint64_t value);
+uint64_t hash_load(const unsigned char *bytes);
+
+#endif
@@ -0,0 +1,906 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "align.h"
+#include "arena.h"
+#include "compare.h"
+#include "diff.h"
+#include "fileio.h"
+#include "mask.h"
+#include "parallel.h"
+#include "prefetch.h"
+#include "remote.h"
+#include "search.h"
+#include "signature.h"
+#include "watch.h"
+
+/* What each worker of hexcompare_blocks() takes from the arena: a piece
+   of each file, and a histogram of each. */
+#define BLOCK_JOB_MEMORY (2 * HEXCOMPARE_PIECE + 512 * sizeof(unsigned long))
+
+struct hexcompare {
+	struct file *file_one;
+	struct file *file_two;
+	struct file *owned;         /* Files opened by hexcompare_open()  */
+	struct prefetch *view;      /* Cache for hexcompare_read(), or NULL */
+	struct search *search;      /* Matches of the last search, or NULL */
+	volatile int cancelled;     /* Set by hexcompare_cancel()         */
+};
+
+struct hexcompare *hexcompare_attach(struct file *file_one,
+                                     struct file *file_two)
+{
+	struct hexcompare *context = calloc(1, sizeof(*context));
+
+	if (context == NULL) return NULL;
+	context->file_one = file_one;
+	context->file_two = file_two;
+	return context;
+}
+
+struct hexcompare *hexcompare_open(const char *name_one,
+                                   const char *name_two)
+{
+	struct file *files = calloc(2, sizeof(struct file));
+	struct hexcompare *context;
+
+	if (files == NULL) return NULL;
+	if (file_open(&files[0], name_one) != 0) {
+		free(files);
+		return NULL;
+	}
+	if (file_open(&files[1], name_two) != 0 ||
+	    file_spool(&files[0]) != 0 || file_spool(&files[1]) != 0 ||
+	    (context = hexcompare_attach(&files[0], &files[1])) == NULL) {
+		file_close(&files[0]);
+		file_close(&files[1]);
+		free(files);
+		return NULL;
+	}
+
+	context->owned = files;
+	return context;
+}
+
+void hexcompare_close(struct hexcompare *context)
+{
+	if (context == NULL) return;
+	prefetch_free(context->view);
+	search_free(context->search);
+	if (context->owned != NULL) {
+		file_close(&context->owned[0]);
+		file_close(&context->owned[1]);
+		free(context->owned);
+	}
+	free(context);
+}
+
+void hexcompare_cancel(struct hexcompare *context)
+{
+	context->cancelled = 1;
+}
+
+unsigned long hexcompare_size(struct hexcompare *context)
+{
+	return (context->file_one->size > context->file_two->size) ?
+	       context->file_one->size : context->file_two->size;
+}
+
+const char *hexcompare_name(struct hexcompare *context, int side)
+{
+	return side == 0 ? context->file_one->name : context->file_two->name;
+}
+
+unsigned long hexcompare_file_size(struct hexcompare *context, int side)
+{
+	return side == 0 ? context->file_one->size : context->file_two->size;
+}
+
+unsigned long hexcompare_start(struct hexcompare *context, int side)
+{
+	return side == 0 ? context->file_one->start : context->file_two->start;
+}
+
+int hexcompare_flags(struct hexcompare *context)
+{
+	struct file *file_two = context->file_two;
+
+	return (file_two->alignment != NULL ? HEXCOMPARE_ALIGNED : 0) |
+	       (file_two->remote != NULL ? HEXCOMPARE_REMOTE : 0) |
+	       (file_two->watch != NULL ? HEXCOMPARE_WATCHED : 0);
+}
+
+unsigned long hexcompare_aligned_offset(struct hexcompare *context,
+                                        unsigned long offset)
+{
+	struct alignment *map = context->file_two->alignment;
+	struct align_segment *segment;
+
+	if (map == NULL || map->count == 0) return offset;
+
+	/* Past the end of the first file, keep the last delta. */
+	segment = align_find(map, offset);
+	if (segment == NULL) segment = &map->segments[map->count - 1];
+	return offset + segment->delta;
+}
+
+int hexcompare_masked(struct hexcompare *context, unsigned long offset)
+{
+	return mask_covers(context->file_two->mask, offset);
+}
+
+int hexcompare_unknown(struct hexcompare *context, unsigned long offset)
+{
+	struct file *file_two = context->file_two;
+
+	if (file_two->pointer != NULL || file_two->remote != NULL ||
+	    file_two->signature == NULL || offset >= file_two->size)
+		return 0;
+	return signature_range_differs(file_two->signature, offset, 1) ?
+	       HEXCOMPARE_DIFFERENT : HEXCOMPARE_SAME;
+}
+
+/* Like hexcompare_range(), and if 'histograms' isn't NULL, also count
+   the byte values of the first file into its first 256 entries, and those
+   of the second into the next 256, while the bytes are at hand. */
+static int compare_range(struct hexcompare *context, unsigned long offset,
+                         unsigned long length, unsigned char *buffer_one,
+                         unsigned char *buffer_two, size_t size,
+                         unsigned long *mismatches, unsigned long *histograms)
+{
+	unsigned long done = 0, total_read = 0;
+
+	/* Compare piece by piece with the vectorized kernel. Bytes only one
+	   file has all differ. */
+	*mismatches = 0;
+	if (size == 0) return -1;
+	while (done < length) {
+		size_t wanted = size, read_one, read_two, common;
+
+		if (context->cancelled) return HEXCOMPARE_CANCELLED;
+		if (length - done < wanted) wanted = length - done;
+		read_one = file_read_at(context->file_one, buffer_one, wanted,
+		                        offset + done);
+		read_two = file_read_at(context->file_two, buffer_two, wanted,
+		                        offset + done);
+
+		common = (read_one < read_two) ? read_one : read_two;
+		if (histograms != NULL) {
+			compare_histogram(buffer_one, read_one, histograms);
+			compare_histogram(buffer_two, read_two, histograms + 256);
+		}
+		mask_apply(context->file_two->mask, offset + done, buffer_one,
+		           buffer_two, common);
+		*mismatches += compare_count(buffer_one, buffer_two, common) +
+		               (read_one + read_two - common * 2);
+		total_read += read_one + read_two;
+		done += wanted;
+	}
+
+	if (total_read == 0) return HEXCOMPARE_EMPTY;
+	return *mismatches != 0 ? HEXCOMPARE_DIFFERENT : HEXCOMPARE_SAME;
+}
+
+int hexcompare_range(struct hexcompare *context, unsigned long offset,
+                     unsigned long length, unsigned char *buffer_one,
+                     unsigned char *buffer_two, size_t size,
+                     unsigned long *mismatches)
+{
+	return compare_range(context, offset, length, buffer_one, buffer_two,
+	                     size, mismatches, NULL);
+}
+
+int hexcompare_diff(struct hexcompare *context, unsigned long offset,
+                    unsigned long length, unsigned char *buffer_one,
+                    unsigned char *buffer_two, size_t size,
+                    hexcompare_callback callback, void *user)
+{
+	unsigned long done = 0, start = 0, end = 0, differing = 0;
+	int pending = 0;
+
+	if (size == 0) return -1;
+	while (done < length) {
+		size_t wanted = size, read_one, read_two, common, longer, i, run;
+
+		if (context->cancelled) return HEXCOMPARE_CANCELLED;
+		if (length - done < wanted) wanted = length - done;
+		read_one = file_read_at(context->file_one, buffer_one, wanted,
+		                        offset + done);
+		read_two = file_read_at(context->file_two, buffer_two, wanted,
+		                        offset + done);
+		if (read_one == 0 && read_two == 0) break;
+
+		/* Bytes only one file has count as one differing run. */
+		common = (read_one < read_two) ? read_one : read_two;
+		mask_apply(context->file_two->mask, offset + done, buffer_one,
+		           buffer_two, common);
+		longer = (read_one > read_two) ? read_one : read_two;
+		for (i = 0;; i = run) {
+			unsigned long at;
+
+			if (i < common)
+				i += compare_skip(buffer_one + i, buffer_two + i,
+				                  common - i);
+			if (i < common) {
+				for (run = i; run < common &&
+				     buffer_one[run] != buffer_two[run]; run++);
+			} else if (i == common && longer > common) {
+				run = longer;
+			} else {
+				break;
+			}
+			at = offset + done + i;
+
+			/* Merge runs close together, report the others. */
+			if (pending && at <= end + DIFF_MERGE_GAP) {
+				end = offset + done + run;
+				differing += run - i;
+			} else {
+				if (pending && callback(user, start, end - start,
+				                        differing) != 0)
+					return 1;
+				start = at;
+				end = offset + done + run;
+				differing = run - i;
+				pending = 1;
+			}
+		}
+
+		done += longer;
+		if (read_one < wanted && read_two < wanted) break;
+	}
+
+	if (pending && callback(user, start, end - start, differing) != 0)
+		return 1;
+	return 0;
+}
+
+void hexcompare_block_range(struct hexcompare *context, unsigned long block,
+                            unsigned long total_blocks,
+                            unsigned long *offset, unsigned long *length)
+{
+	unsigned long size = hexcompare_size(context);
+	unsigned long bytes_per_block = size / total_blocks;
+	unsigned long blocks_with_excess_byte = size % total_blocks;
+
+	/* The first 'blocks_with_excess_byte' blocks are one byte longer. */
+	*offset = bytes_per_block * block + (block < blocks_with_excess_byte ?
+	          block : blocks_with_excess_byte);
+	*length = bytes_per_block + (block < blocks_with_excess_byte ? 1 : 0);
+}
+
+/* Look at a few small windows spread over a block instead of all of it.
+   A differing window proves the block differs, matching windows only
+   suggest it's the same, so the result is flagged HEXCOMPARE_SAMPLED. */
+static int sample_range(struct hexcompare *context, unsigned long offset,
+                        unsigned long length, unsigned char *buffer_one,
+                        unsigned char *buffer_two, unsigned long *mismatches)
+{
+	unsigned long stride;
+	int k;
+
+	if (length <= HEXCOMPARE_SAMPLES * HEXCOMPARE_SAMPLE_SIZE)
+		return hexcompare_range(context, offset, length, buffer_one,
+		                        buffer_two, HEXCOMPARE_PIECE, mismatches);
+
+	stride = (length - HEXCOMPARE_SAMPLE_SIZE) / (HEXCOMPARE_SAMPLES - 1);
+	for (k = 0; k < HEXCOMPARE_SAMPLES; k++) {
+		int state = hexcompare_range(context, offset + stride * k,
+		                             HEXCOMPARE_SAMPLE_SIZE, buffer_one,
+		                             buffer_two, HEXCOMPARE_PIECE,
+		                             mismatches);
+		if (state == HEXCOMPARE_CANCELLED) return state;
+		if (state != HEXCOMPARE_SAME &&
+		    (state != HEXCOMPARE_EMPTY || k == 0)) {
+			*mismatches = HEXCOMPARE_UNKNOWN;
+			return state == HEXCOMPARE_EMPTY ? HEXCOMPARE_EMPTY
+			       : HEXCOMPARE_DIFFERENT | HEXCOMPARE_SAMPLED;
+		}
+	}
+
+	*mismatches = 0;
+	return HEXCOMPARE_SAME | HEXCOMPARE_SAMPLED;
+}
+
+/* Blocks handed to the worker threads. */
+struct block_job {
+	struct hexcompare *context;
+	unsigned long first_block;
+	unsigned long total_blocks;
+	unsigned long offset;   /* Range cut into pieces, if length isn't 0 */
+	unsigned long length;
+	char *states;
+	unsigned long *mismatches;
+	struct hexcompare_stats *stats;
+	int sample;
+	int stats_only;
+	int failed;
+};
+
+/* Where block 'block' of a job starts and how long it is: a block of the
+   overview, or one of 'total_blocks' pieces of the job's range, which are
+   cut the same way. */
+static void job_range(struct block_job *job, unsigned long block,
+                      unsigned long *offset, unsigned long *length)
+{
+	unsigned long bytes_per_piece, pieces_with_excess_byte;
+
+	if (job->length == 0) {
+		hexcompare_block_range(job->context, block, job->total_blocks,
+		                       offset, length);
+		return;
+	}
+	bytes_per_piece = job->length / job->total_blocks;
+	pieces_with_excess_byte = job->length % job->total_blocks;
+	*offset = job->offset + bytes_per_piece * block +
+	          (block < pieces_with_excess_byte ? block
+	           : pieces_with_excess_byte);
+	*length = bytes_per_piece + (block < pieces_with_excess_byte ? 1 : 0);
+}
+
+/* Work out the state of one block, reading it only when nothing else
+   tells. If 'histograms' isn't NULL and the block is read in full, its
+   bytes are counted into them. */
+static int compare_block(struct block_job *job, unsigned long offset,
+                         unsigned long length, unsigned char *buffer_one,
+                         unsigned char *buffer_two, unsigned long *count,
+                         unsigned long *histograms)
+{
+	struct hexcompare *context = job->context;
+	struct file *file_one = context->file_one;
+	struct file *file_two = context->file_two;
+	struct signature *signature = file_two->signature;
+	struct alignment *alignment = file_two->alignment;
+	struct watch *watch = file_two->watch;
+
+	*count = 0;
+
+	/* With an alignment, the map already tells where the content of
+	   each block of the first file went. */
+	if (alignment != NULL) {
+		if (offset >= file_one->size || length == 0)
+			return HEXCOMPARE_EMPTY;
+		switch (align_range_state(alignment, offset, length)) {
+			case ALIGN_SHIFTED:
+				return HEXCOMPARE_SHIFTED;
+			case ALIGN_DIFFERENT:
+				*count = HEXCOMPARE_UNKNOWN;
+				return HEXCOMPARE_DIFFERENT;
+		}
+		return HEXCOMPARE_SAME;
+	}
+
+	/* With a signature, a block whose chunks all hash the same is known
+	   to match without reading it. The others are only read if the
+	   second file is actually there. */
+	if (signature != NULL) {
+		if (offset >= file_one->size && offset >= file_two->size)
+			return HEXCOMPARE_EMPTY;
+		if (!signature_range_differs(signature, offset, length))
+			return HEXCOMPARE_SAME;
+		if (file_two->pointer == NULL) {
+			*count = HEXCOMPARE_UNKNOWN;
+			return HEXCOMPARE_DIFFERENT;
+		}
+	}
+
+	/* While watching, a block whose chunks hash the same in both files
+	   is known to match without reading it. */
+	if (watch != NULL && !watch_range_differs(watch, offset, length)) {
+		if (offset >= file_one->size && offset >= file_two->size)
+			return HEXCOMPARE_EMPTY;
+		return HEXCOMPARE_SAME;
+	}
+
+	if (job->sample)
+		return sample_range(context, offset, length, buffer_one,
+		                    buffer_two, count);
+
+	return compare_range(context, offset, length, buffer_one, buffer_two,
+	                     HEXCOMPARE_PIECE, count, histograms);
+}
+
+/* Count the byte values of one file over a range. */
+static int count_range(struct hexcompare *context, struct file *f,
+                       unsigned long offset, unsigned long length,
+                       unsigned char *buffer, unsigned long *histogram)
+{
+	unsigned long done = 0;
+
+	while (done < length) {
+		size_t wanted = HEXCOMPARE_PIECE, got;
+
+		if (context->cancelled) return HEXCOMPARE_CANCELLED;
+		if (length - done < wanted) wanted = length - done;
+		got = file_read_at(f, buffer, wanted, offset + done);
+		compare_histogram(buffer, got, histogram);
+		if (got < wanted) break;
+		done += wanted;
+	}
+	return 0;
+}
+
+/* Sum up a histogram of 256 byte values. */
+static void summarize(const unsigned long *histogram,
+                      struct hexcompare_stats *stats)
+{
+	unsigned long total = 0;
+	double entropy = 0;
+	int k;
+
+	memset(stats, 0, sizeof(*stats));
+	for (k = 0; k < 256; k++) total += histogram[k];
+	if (total == 0) return;
+
+	for (k = 0; k < 256; k++) {
+		double share = (double) histogram[k] / total;
+
+		if (histogram[k] == 0) continue;
+		entropy -= share * log(share);
+		stats->distinct++;
+		if (histogram[k] > histogram[stats->common]) stats->common = k;
+	}
+
+	/* Small blocks can't show every byte value, which makes their
+	   entropy come out low; the Miller-Madow term makes up for it. */
+	entropy += (stats->distinct - 1) / (2.0 * total);
+	entropy /= log(2.0);
+
+	stats->length = total;
+	stats->entropy = (entropy > 8) ? 8 : (entropy > 0) ? entropy : 0;
+	stats->zeros = (double) histogram[0] / total;
+	stats->common_share = (double) histogram[stats->common] / total;
+}
+
+/* Fill in the statistics of a block whose bytes compare_block() didn't
+   count, reading the second file only if it may differ from the first. */
+static int count_block(struct block_job *job, int state, unsigned long offset,
+                       unsigned long length, unsigned char *buffer,
+                       unsigned long *histograms)
+{
+	struct hexcompare *context = job->context;
+	struct file *file_two = context->file_two;
+
+	if (count_range(context, context->file_one, offset, length, buffer,
+	                histograms) != 0)
+		return HEXCOMPARE_CANCELLED;
+
+	if (state == HEXCOMPARE_SAME && file_two->alignment == NULL) {
+		memcpy(histograms + 256, histograms, 256 * sizeof(unsigned long));
+		return 0;
+	}
+	return count_range(context, file_two, offset, length, buffer,
+	                   histograms + 256);
+}
+
+/* Flag the blocks a worker couldn't get to as not verified, so that they
+   are compared again rather than shown as empty. */
+static void give_up(struct block_job *job, unsigned long first,
+                    unsigned long last)
+{
+	job->failed = 1;
+	if (job->stats_only) return;
+	for (; first < last; first++)
+		job->states[job->first_block + first] |= HEXCOMPARE_SAMPLED;
+}
+
+/* Compare the blocks first..last-1 of a job in one pass, when no block
+   can be told without reading it. Blocks may be a few bytes each, so the
+   run is read in whole pieces, and the counts are split up at the block
+   boundaries. Returns the first block left out, 'last' unless cancelled. */
+static unsigned long compare_run(struct block_job *job, unsigned long first,
+                                 unsigned long last,
+                                 unsigned char *buffer_one,
+                                 unsigned char *buffer_two,
+                                 unsigned long *histograms)
+{
+	struct hexcompare *context = job->context;
+	struct file *file_one = context->file_one;
+	struct file *file_two = context->file_two;
+	unsigned long piece = 0, size = 0, end, length, i;
+	size_t read_one = 0, read_two = 0;
+
+	job_range(job, job->first_block + last - 1, &end, &length);
+	end += length;
+
+	for (i = first; i < last; i++) {
+		unsigned long block = job->first_block + i, offset, present = 0;
+
+		job_range(job, block, &offset, &length);
+		job->mismatches[block] = 0;
+		if (histograms != NULL)
+			memset(histograms, 0, 512 * sizeof(unsigned long));
+
+		while (length > 0) {
+			size_t position, count, one, two, common;
+
+			/* Read on where the previous piece ends. */
+			if (offset >= piece + size) {
+				if (context->cancelled) return i;
+				piece = offset;
+				size = end - offset;
+				if (size > HEXCOMPARE_PIECE)
+					size = HEXCOMPARE_PIECE;
+				read_one = file_read_at(file_one, buffer_one,
+				                        size, piece);
+				read_two = file_read_at(file_two, buffer_two,
+				                        size, piece);
+			}
+
+			/* What each file has of this stretch of the block. */
+			position = offset - piece;
+			count = piece + size - offset;
+			if (count > length) count = length;
+			one = read_one > position ? read_one - position : 0;
+			two = read_two > position ? read_two - position : 0;
+			if (one > count) one = count;
+			if (two > count) two = count;
+			common = one < two ? one : two;
+
+			if (histograms != NULL) {
+				compare_histogram(buffer_one + position, one,
+				                  histograms);
+				compare_histogram(buffer_two + position, two,
+				                  histograms + 256);
+			}
+			mask_apply(file_two->mask, offset, buffer_one + position,
+			           buffer_two + position, common);
+			job->mismatches[block] +=
+				compare_count(buffer_one + position,
+				              buffer_two + position, common) +
+				(one + two - common * 2);
+			present += one + two;
+			offset += count;
+			length -= count;
+		}
+
+		job->states[block] = present == 0 ? HEXCOMPARE_EMPTY
+		                     : job->mismatches[block] != 0 ?
+		                     HEXCOMPARE_DIFFERENT : HEXCOMPARE_SAME;
+		if (histograms == NULL) continue;
+		summarize(histograms, &job->stats[block * 2]);
+		summarize(histograms + 256, &job->stats[block * 2 + 1]);
+	}
+	return last;
+}
+
+static void compare_blocks(void *job_context, unsigned long first,
+                           unsigned long last)
+{
+	struct block_job *job = job_context;
+	struct file *file_two = job->context->file_two;
+	unsigned char *buffer_one, *buffer_two;
+	unsigned long *histograms = NULL;
+	unsigned long i;
+
+	/* Both pieces and the histograms in one buffer from the arena, so
+	   that a worker never holds part of its memory while waiting for the
+	   rest, and a rescan reuses the buffers of the previous one. */
+	buffer_one = arena_get(BLOCK_JOB_MEMORY);
+	if (buffer_one == NULL) {
+		give_up(job, first, last);
+		return;
+	}
+	buffer_two = buffer_one + HEXCOMPARE_PIECE;
+	if (job->stats != NULL)
+		histograms = (unsigned long *) (buffer_two + HEXCOMPARE_PIECE);
+
+	/* Without hashes or a map to go by, every block is read in full. */
+	if (!job->stats_only && !job->sample && file_two->alignment == NULL &&
+	    file_two->signature == NULL && file_two->watch == NULL) {
+		i = compare_run(job, first, last, buffer_one, buffer_two,
+		                histograms);
+		if (i < last) give_up(job, i, last);
+		arena_put(buffer_one);
+		return;
+	}
+
+	for (i = first; i < last; i++) {
+		unsigned long block = job->first_block + i;
+		unsigned long offset, length;
+		int result;
+
+		job_range(job, block, &offset, &length);
+
+		if (histograms != NULL)
+			memset(histograms, 0, 512 * sizeof(unsigned long));
+
+		/* Statistics come from the bytes a comparison reads anyway.
+		   Only hexcompare_block_stats() reads the blocks whose state was
+		   known beforehand for them, once they have been verified. */
+		if (job->stats_only) {
+			result = job->states[block];
+			if ((result & HEXCOMPARE_SAMPLED) ||
+			    job->stats[block * 2].length != 0 ||
+			    job->stats[block * 2 + 1].length != 0)
+				continue;
+			if (count_block(job, result, offset, length, buffer_one,
+			                histograms) != 0) {
+				give_up(job, i, last);
+				break;
+			}
+		} else {
+			result = compare_block(job, offset, length, buffer_one,
+			                       buffer_two, &job->mismatches[block],
+			                       histograms);
+			if (result == HEXCOMPARE_CANCELLED) {
+				give_up(job, i, last);
+				break;
+			}
+			job->states[block] = result;
+			if (histograms == NULL) continue;
+		}
+		summarize(histograms, &job->stats[block * 2]);
+		summarize(histograms + 256, &job->stats[block * 2 + 1]);
+	}
+
+	arena_put(buffer_one);
+}
+
+/* A remote file is compared by block hashes. The agent reads its side of
+   every block, and only the hashes come over the wire. How many bytes
+   differ isn't known. */
+static int compare_remote_blocks(struct block_job *job, unsigned long count)
+{
+	struct hexcompare *context = job->context;
+	unsigned long first = job->first_block;
+	char *states = job->states;
+	unsigned long *mismatches = job->mismatches;
+	unsigned long offset, length, end, i;
+
+	job_range(job, first, &offset, &length);
+	job_range(job, first + count - 1, &end, &length);
+	end += length;
+
+	if (remote_compare_parts(context->file_two->remote, context->file_one,
+	                         offset, end - offset, count,
+	                         states + first) != 0) {
+		/* The reply may have overwritten the states: none is known. */
+		memset(states + first, HEXCOMPARE_EMPTY | HEXCOMPARE_SAMPLED,
+		       count);
+		return -1;
+	}
+
+	for (i = first; i < first + count; i++) {
+		job_range(job, i, &offset, &length);
+		mismatches[i] = 0;
+		if (length == 0)
+			states[i] = HEXCOMPARE_EMPTY;
+		else
+			states[i] = states[i] ? HEXCOMPARE_DIFFERENT : HEXCOMPARE_SAME;
+		if (states[i] == HEXCOMPARE_DIFFERENT)
+			mismatches[i] = HEXCOMPARE_UNKNOWN;
+	}
+	return 0;
+}
+
+int hexcompare_blocks(struct hexcompare *context, unsigned long first,
+                      unsigned long count, unsigned long total_blocks,
+                      char *states, unsigned long *mismatches,
+                      struct hexcompare_stats *stats, int sample)
+{
+	struct block_job job;
+
+	if (count == 0) return 0;
+
+	job.context = context;
+	job.first_block = first;
+	job.total_blocks = total_blocks;
+	job.offset = 0;
+	job.length = 0;
+	job.states = states;
+	job.mismatches = mismatches;
+	job.stats = stats;
+	job.sample = sample;
+	job.stats_only = 0;
+	job.failed = 0;
+
+	if (context->file_two->remote != NULL) {
+		if (stats != NULL)
+			memset(stats + first * 2, 0, count * 2 * sizeof(*stats));
+		return compare_remote_blocks(&job, count);
+	}
+
+	parallel_run_sized(count, BLOCK_JOB_MEMORY, compare_blocks, &job);
+
+	return job.failed ? -1 : 0;
+}
+
+int hexcompare_pieces(struct hexcompare *context, unsigned long offset,
+                      unsigned long length, unsigned long count,
+                      char *states, unsigned long *mismatches)
+{
+	struct block_job job;
+
+	if (count == 0) return 0;
+	if (length == 0) {
+		memset(states, HEXCOMPARE_EMPTY, count);
+		memset(mismatches, 0, count * sizeof(*mismatches));
+		return 0;
+	}
+
+	job.context = context;
+	job.first_block = 0;
+	job.total_blocks = count;
+	job.offset = offset;
+	job.length = length;
+	job.states = states;
+	job.mismatches = mismatches;
+	job.stats = NULL;
+	job.sample = 0;
+	job.stats_only = 0;
+	job.failed = 0;
+
+	if (context->file_two->remote != NULL)
+		return compare_remote_blocks(&job, count);
+
+	parallel_run_sized(count, BLOCK_JOB_MEMORY, compare_blocks, &job);
+
+	return job.failed ? -1 : 0;
+}
+
+int hexcompare_block_stats(struct hexcompare *context, unsigned long first,
+                           unsigned long count, unsigned long total_blocks,
+                           char *states, struct hexcompare_stats *stats)
+{
+	struct block_job job;
+
+	if (count == 0) return 0;
+	if (context->file_two->remote != NULL) {
+		memset(stats + first * 2, 0, count * 2 * sizeof(*stats));
+		return 0;
+	}
+
+	job.context = context;
+	job.first_block = first;
+	job.total_blocks = total_blocks;
+	job.offset = 0;
+	job.length = 0;
+	job.states = states;
+	job.mismatches = NULL;
+	job.stats = stats;
+	job.sample = 0;
+	job.stats_only = 1;
+	job.failed = 0;
+
+	parallel_run_sized(count, BLOCK_JOB_MEMORY, compare_blocks, &job);
+
+	return job.failed ? -1 : 0;
+}
+
+int hexcompare_poll(struct hexcompare *context)
+{
+	struct watch *watch = context->file_two->watch;
+
+	if (watch == NULL || watch_poll(watch) == 0) return 0;
+	if (context->view != NULL) prefetch_drop(context->view);
+	return 1;
+}
+
+int hexcompare_refresh(struct hexcompare *context,
+                       unsigned long total_blocks, char *states,
+                       unsigned long *mismatches,
+                       struct hexcompare_stats *stats)
+{
+	struct watch *watch = context->file_two->watch;
+	unsigned long i, first = 0;
+	int run = 0, result = 0;
+
+	if (watch == NULL) return 0;
+
+	for (i = 0; i <= total_blocks; i++) {
+		unsigned long offset, length;
+		int changed = 0;
+
+		if (i < total_blocks) {
+			hexcompare_block_range(context, i, total_blocks, &offset,
+			                       &length);
+			changed = watch_range_changed(watch, offset, length);
+		}
+
+		/* Compare each run of changed blocks in one go. */
+		if (changed && !run) {
+			first = i;
+			run = 1;
+		}
+		if (!changed && run) {
+			if (hexcompare_blocks(context, first, i - first, total_blocks,
+			                      states, mismatches, stats, 0) != 0)
+				result = -1;
+			run = 0;
+		}
+	}
+	return result;
+}
+
+/* The cache is only made once the files are viewed. */
+static struct prefetch *view_cache(struct hexcompare *context)
+{
+	if (context->view == NULL)
+		context->view = prefetch_create(context->file_one,
+		                                context->file_two);
+	return context->view;
+}
+
+size_t hexcompare_read(struct hexcompare *context, int side, void *buffer,
+                       size_t length, unsigned long offset)
+{
+	struct prefetch *view = view_cache(context);
+
+	if (view == NULL)
+		return file_read_at(side == 0 ? context->file_one
+		                    : context->file_two, buffer, length, offset);
+	return prefetch_read(view, side, buffer, length, offset);
+}
+
+void hexcompare_view(struct hexcompare *context, unsigned long offset,
+                     unsigned long screen)
+{
+	struct prefetch *view = view_cache(context);
+
+	if (view != NULL)
+		prefetch_moved(view, offset,
+		               hexcompare_aligned_offset(context, offset), screen);
+}
+
+int hexcompare_read_ahead(struct hexcompare *context)
+{
+	return context->view != NULL ? prefetch_step(context->view) : 0;
+}
+
+long hexcompare_search(struct hexcompare *context, const char *pattern)
+{
+	search_free(context->search);
+	context->search = search_files(pattern, context->file_one,
+	                               context->file_two);
+	if (context->search == NULL) return -1;
+	return (long) (context->search->count[0] + context->search->count[1]);
+}
+
+int hexcompare_search_next(struct hexcompare *context, unsigned long offset,
+                           int direction, unsigned long *found)
+{
+	if (context->search == NULL) return -1;
+	return search_next(context->search, offset, direction, found);
+}
+
+unsigned long hexcompare_search_count(struct hexcompare *context,
+                                      unsigned long offset,
+                                      unsigned long length)
+{
+	if (context->search == NULL) return 0;
+	return search_count(context->search, offset, length);
+}
+
+int hexcompare_threads(void)
+{
+	return parallel_threads();
+}
+
+void *hexcompare_alloc(size_t size)
+{
+	return arena_get(size);
+}
+
+void hexcompare_free(void *buffer)
+{
+	arena_put(buffer);
+}
@@ -0,0 +1,223 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_HEXCOMPARE
+#define HEX_HEXCOMPARE
+
+#include <stddef.h>
+
+/* The comparison engine behind the interface, as a library. A context
+   holds a pair of files. The comparisons (hexcompare_range(),
+   hexcompare_diff(), hexcompare_blocks(), hexcompare_pieces() and
+   hexcompare_block_stats()), the questions about the files,
+   hexcompare_cancel() and the buffers may be used from several threads
+   at once, each with its own buffers, except on remote files. Polling,
+   the cached reads and the search keep state in the context: each of
+   them from one thread at a time, while no other function runs on the
+   same context. */
+
+#define HEXCOMPARE_SAME 1       /* Both files hold the same bytes       */
+#define HEXCOMPARE_DIFFERENT 2  /* Some bytes differ                    */
+#define HEXCOMPARE_EMPTY 3      /* Neither file has data there          */
+#define HEXCOMPARE_SHIFTED 6    /* Found at another offset when aligned */
+#define HEXCOMPARE_SAMPLED 0x40 /* Flag: only sampled, not verified yet */
+
+#define HEXCOMPARE_UNKNOWN ((unsigned long) -1) /* Not counted per byte */
+#define HEXCOMPARE_CANCELLED -2 /* Returned once cancelled */
+
+#define HEXCOMPARE_ALIGNED 1    /* Flag: second file aligned to the first */
+#define HEXCOMPARE_REMOTE 2     /* Flag: second file served by an agent   */
+#define HEXCOMPARE_WATCHED 4    /* Flag: both files watched for changes   */
+#define HEXCOMPARE_POLL_INTERVAL 250 /* Milliseconds between polls */
+
+#define HEXCOMPARE_PIECE 1048576 /* Buffer size per file for blocks */
+#define HEXCOMPARE_SAMPLES 4     /* Windows looked at per sampled block */
+#define HEXCOMPARE_SAMPLE_SIZE 256 /* Bytes in a sample window */
+#define HEXCOMPARE_MAX_PATTERN 256 /* Longest search pattern, in bytes */
+
+struct hexcompare;
+
+/* Byte statistics of one file over one block. */
+struct hexcompare_stats {
+	unsigned long length;     /* Bytes counted, 0 if not known          */
+	float entropy;            /* Shannon entropy, 0 to 8 bits per byte  */
+	float zeros;              /* Share of zero bytes                    */
+	float common_share;       /* Share of the most frequent byte value  */
+	unsigned char common;     /* The most frequent byte value           */
+	unsigned short distinct;  /* Number of byte values that occur       */
+};
+
+/* Called for each differing range, in order. 'differing' counts the bytes
+   in it that differ, as it may hold a few equal ones. Returning non-zero
+   stops the iteration. */
+typedef int (*hexcompare_callback)(void *user, unsigned long offset,
+                                   unsigned long length,
+                                   unsigned long differing);
+
+/* The shared library is built with hidden visibility; only the functions
+   declared here are exported from it. */
+#if defined(__GNUC__) && __GNUC__ >= 4 && defined(__ELF__)
+#pragma GCC visibility push(default)
+#endif
+
+/* Open two files by name, as the command line does. Returns NULL on
+   error. */
+struct hexcompare *hexcompare_open(const char *name_one,
+                                   const char *name_two);
+void hexcompare_close(struct hexcompare *context);
+
+/* Make every comparison running on the context return
+   HEXCOMPARE_CANCELLED soon, from any thread. Later ones do too. */
+void hexcompare_cancel(struct hexcompare *context);
+
+/* Size of the larger file. */
+unsigned long hexcompare_size(struct hexcompare *context);
+
+/* About each file, 'side' being 0 for the first and 1 for the second:
+   its name, its size, and where in it the compared range starts. Offsets
+   given to and returned by the engine count from that start. */
+const char *hexcompare_name(struct hexcompare *context, int side);
+unsigned long hexcompare_file_size(struct hexcompare *context, int side);
+unsigned long hexcompare_start(struct hexcompare *context, int side);
+
+/* HEXCOMPARE_ALIGNED, HEXCOMPARE_REMOTE and HEXCOMPARE_WATCHED, as they
+   apply to the pair. */
+int hexcompare_flags(struct hexcompare *context);
+
+/* Where a byte of the first file is found in the second: at the same
+   offset, unless the files are aligned. */
+unsigned long hexcompare_aligned_offset(struct hexcompare *context,
+                                        unsigned long offset);
+
+/* Whether the mask leaves out the byte at 'offset'. */
+int hexcompare_masked(struct hexcompare *context, unsigned long offset);
+
+/* Returns 0 if the byte at 'offset' of the second file can be read. If
+   only a signature of it was loaded, returns HEXCOMPARE_SAME or
+   HEXCOMPARE_DIFFERENT, as the hash of its chunk tells. */
+int hexcompare_unknown(struct hexcompare *context, unsigned long offset);
+
+/* Compare a range through the caller's buffers, 'size' bytes each.
+   Stores the number of differing bytes, and returns HEXCOMPARE_SAME,
+   HEXCOMPARE_DIFFERENT or HEXCOMPARE_EMPTY, HEXCOMPARE_CANCELLED once
+   cancelled, or -1 if 'size' is 0. */
+int hexcompare_range(struct hexcompare *context, unsigned long offset,
+                     unsigned long length, unsigned char *buffer_one,
+                     unsigned char *buffer_two, size_t size,
+                     unsigned long *mismatches);
+
+/* Call back for each differing range within a range. Ranges separated by
+   a few equal bytes are merged. Returns 0, 1 if the callback stopped,
+   HEXCOMPARE_CANCELLED once cancelled, or -1 if 'size' is 0. */
+int hexcompare_diff(struct hexcompare *context, unsigned long offset,
+                    unsigned long length, unsigned char *buffer_one,
+                    unsigned char *buffer_two, size_t size,
+                    hexcompare_callback callback, void *user);
+
+/* Where block 'block' of an overview of 'total_blocks' blocks starts,
+   and how many bytes it holds. */
+void hexcompare_block_range(struct hexcompare *context, unsigned long block,
+                            unsigned long total_blocks,
+                            unsigned long *offset, unsigned long *length);
+
+/* Fill in the state and differing byte count of blocks first..first+
+   count-1 of such an overview, on all threads, each with buffers of
+   HEXCOMPARE_PIECE bytes. With 'sample', blocks are only sampled and
+   flagged HEXCOMPARE_SAMPLED. Signatures, alignments, remote files and
+   watched files are taken into account. Returns 0, or -1 on error, such
+   as running out of buffers or being cancelled; the blocks that weren't
+   compared then are flagged HEXCOMPARE_SAMPLED as well.
+
+   Unless 'stats' is NULL, it gets two entries per block, for the first
+   and the second file, from the same reads. Blocks that aren't read in
+   full, as their state is known without it or they are only sampled, get
+   none (a length of 0), nor do remote files. */
+int hexcompare_blocks(struct hexcompare *context, unsigned long first,
+                      unsigned long count, unsigned long total_blocks,
+                      char *states, unsigned long *mismatches,
+                      struct hexcompare_stats *stats, int sample);
+
+/* Compare 'length' bytes from 'offset', cut into 'count' pieces as an
+   overview cuts the files into blocks, on all threads: the state of each
+   piece and how many of its bytes differ go into states[0..count-1] and
+   mismatches[0..count-1]. For verifying a block too large to read at once
+   a part at a time, or an overview too large to keep a band of blocks at
+   a time. Returns 0, or -1 as hexcompare_blocks() does. */
+int hexcompare_pieces(struct hexcompare *context, unsigned long offset,
+                      unsigned long length, unsigned long count,
+                      char *states, unsigned long *mismatches);
+
+/* Fill in the statistics hexcompare_blocks() left out among blocks
+   first..first+count-1, as 'states' tells, by reading those blocks: of
+   the second file only where it may differ from the first. Sampled blocks
+   are left until verified. Returns 0, or -1 on error. */
+int hexcompare_block_stats(struct hexcompare *context, unsigned long first,
+                           unsigned long count, unsigned long total_blocks,
+                           char *states, struct hexcompare_stats *stats);
+
+/* For watched files: check for changes without blocking. Returns 1 if
+   either file changed, after which the sizes are updated, or 0 if nothing
+   changed. Then hexcompare_refresh() compares again the blocks of such an
+   overview that overlap changed chunks, returning 0 or -1 as
+   hexcompare_blocks() does. From one thread at a time, as both files may
+   change size and the read cache is dropped. */
+int hexcompare_poll(struct hexcompare *context);
+int hexcompare_refresh(struct hexcompare *context,
+                       unsigned long total_blocks, char *states,
+                       unsigned long *mismatches,
+                       struct hexcompare_stats *stats);
+
+/* Read like a view of the files does, through a cache of pages around
+   it: 'side' is 0 or 1, and the second file is read at the offset given,
+   not the aligned one. After each move, hexcompare_view() tells where the
+   view starts in the first file and how many bytes it shows, and while
+   the caller is idle, hexcompare_read_ahead() reads a page of the next
+   screens in the direction it moves. That returns 1 while there may be
+   more to read. From one thread at a time. */
+size_t hexcompare_read(struct hexcompare *context, int side, void *buffer,
+                       size_t length, unsigned long offset);
+void hexcompare_view(struct hexcompare *context, unsigned long offset,
+                     unsigned long screen);
+int hexcompare_read_ahead(struct hexcompare *context);
+
+/* Search both files for a pattern, text or "0x" followed by hex bytes, on
+   all threads, replacing the previous search. Returns the number of
+   matches, or -1 on error or for an invalid pattern. Then find the
+   nearest match in either file after 'offset' (direction 1), at or after
+   it (0) or before it (-1), returning 0 and setting *found, or -1 if
+   there is none; and count the matches starting within a range. From one
+   thread at a time, as a new search frees the previous one. */
+long hexcompare_search(struct hexcompare *context, const char *pattern);
+int hexcompare_search_next(struct hexcompare *context, unsigned long offset,
+                           int direction, unsigned long *found);
+unsigned long hexcompare_search_count(struct hexcompare *context,
+                                      unsigned long offset,
+                                      unsigned long length);
+
+/* How many threads the engine uses at most. */
+int hexcompare_threads(void);
+
+/* Page-aligned buffers from the pool the engine's own workers use, e.g.
+   for hexcompare_range(). NULL on error. */
+void *hexcompare_alloc(size_t size);
+void hexcompare_free(void *buffer);
+
+#if defined(__GNUC__) && __GNUC__ >= 4 && defined(__ELF__)
+#pragma GCC visibility pop
+#endif
+
+#endif
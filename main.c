@@ -13,66 +13,482 @@
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "general.h"
+#include "align.h"
+#include "diff.h"
+#include "engine.h"
+#include "fileio.h"
 #include "gui.h"
+#include "map.h"
+#include "mask.h"
+#include "patch.h"
+#include "remote.h"
+#include "search.h"
+#include "signature.h"
+#include "watch.h"
+
+static const char *usage_options[] = {
+	"  --report              Print the differing ranges and exit.\n",
+	"  --make-signature OUT  Write a block-hash signature of file1 to OUT.\n",
+	"  --chunk-size N        Bytes per signature chunk (default 65536).\n",
+	"  --signature SIG       Compare file1 against the signature SIG of "
+	"file2.\n",
+	"  --remote CMD          Compare file1 against the file served by CMD,\n"
+	"                        e.g. \"ssh host hexcompare --serve file2\".\n",
+	"  --serve FILE          Serve FILE to a remote hexcompare on "
+	"stdin/stdout.\n",
+	"  --find PATTERN        Print the offsets of PATTERN in both files and "
+	"exit.\n"
+	"                        PATTERN is text, or 0x and hex bytes.\n",
+	"  --align               Match moved and shifted content instead of "
+	"comparing\n"
+	"                        at identical offsets.\n",
+	"  --progressive         Show a sampled overview at once and verify "
+	"it while\n"
+	"                        browsing, for very large files.\n",
+	"  --watch               Update the view when either file changes.\n",
+	"  --export-map=WxH OUT  Write the overview as an image of WxH blocks "
+	"to OUT,\n"
+	"                        a .png or .ppm file, and exit.\n",
+	"  --map-heat            Shade the image by the share of bytes that "
+	"differ.\n",
+	"  --emit-patch OUT      Write a patch that turns file1 into file2 to "
+	"OUT,\n"
+	"                        and exit.\n",
+	"  --apply-patch PATCH   Apply PATCH to file1, in place, and exit.\n",
+	"  --range FIRST-LAST    Compare only these bytes of both files.\n",
+	"  --offset1 N           Compare file1 from offset N on.\n",
+	"  --offset2 N           Compare file2 from offset N on.\n",
+	"  --length N            Compare at most N bytes of each file.\n",
+	"  --mask FILE           Ignore the bytes of file1 listed in FILE, one "
+	"range\n"
+	"                        \"FIRST-LAST\" per line.\n",
+	NULL
+};
+
+/* Parse "FIRST-LAST", both included. Returns 0 on success. */
+static int parse_range(const char *text, unsigned long *first,
+                       unsigned long *length)
+{
+	unsigned long last;
+	char *end;
+
+	*first = strtoul(text, &end, 0);
+	if (end == text || *end != '-') return -1;
+	text = end + 1;
+	last = strtoul(text, &end, 0);
+	if (end == text || *end != '\0' || last < *first) return -1;
+	*length = last - *first + 1;
+	return 0;
+}
 
+/* Parse "WxH", in decimal, both at least 1 and no more blocks than fit
+   in an unsigned long. Returns 0 on success. */
+static int parse_size(const char *text, unsigned long *width,
+                      unsigned long *height)
+{
+	char *end;
+
+	if (*text < '0' || *text > '9') return -1;
+	*width = strtoul(text, &end, 10);
+	if (*end != 'x' || end[1] < '0' || end[1] > '9') return -1;
+	text = end + 1;
+	*height = strtoul(text, &end, 10);
+	if (*end != '\0' || *width == 0 || *height == 0 ||
+	    *width > ULONG_MAX / *height)
+		return -1;
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
 	struct file file_one, file_two;
-	unsigned long largest_file_size;
+	struct diff_index index, coarse;
+	struct signature *signature = NULL;
+	unsigned long chunk_size = DEFAULT_CHUNK_SIZE;
+	char *names[2] = { NULL, NULL };
+	char *make_signature = NULL, *signature_name = NULL;
+	char *serve = NULL, *remote_command = NULL, *find = NULL;
+	char *map_path = NULL, *patch_path = NULL, *apply_path = NULL;
+	unsigned long map_width = 0, map_height = 0;
+	unsigned long offset_one = 0, offset_two = 0, length = FILE_WHOLE;
+	char *mask_path = NULL;
+	int i, files = 0, report = 0, align = 0, progressive = 0, watch = 0;
+	int map_heat = 0, ranged;
+	int stream_report, result = 0;
 	char *message[] = {
 		"Arguments missing.\n",
-		"Usage:\n  hexcompare file1 [file2]\n",
-		"Failed to open file \"%s\".\n"
+		"Usage:\n  hexcompare [options] file1 [file2]\n\nOptions:\n",
+		"Failed to open file \"%s\".\n",
+		"Unknown or incomplete option \"%s\".\n",
+		"Invalid signature file \"%s\".\n",
+		"Signature \"%s\" was not made from \"%s\".\n",
+		"Failed to read the files.\n",
+		"Failed to start remote agent \"%s\".\n",
+		"Aligning needs the data of both files.\n",
+		"Invalid search pattern \"%s\".\n",
+		"Watching needs two local files.\n",
+		"Exporting a map needs the data of both files.\n",
+		"Writing a patch needs the data of both files.\n",
+		"Failed to write \"%s\".\n",
+		"Failed to apply patch \"%s\" to \"%s\".\n",
+		"Ranges and masks can't be used with a remote file.\n",
+		"The range lies past the end of \"%s\".\n",
+		"Invalid mask file \"%s\".\n",
+		"Writing a patch needs the whole files, without a range.\n",
+		"Writing a patch needs every byte compared, without a mask.\n",
+		"Aligning can't be used with a remote file.\n",
+		"Invalid map size \"%s\", expected WxH blocks.\n"
 	};
 
+	/* Sort the arguments into options and file names. */
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--report") == 0) {
+			report = 1;
+		} else if (strcmp(argv[i], "--find") == 0 && i+1 < argc) {
+			find = argv[++i];
+		} else if (strcmp(argv[i], "--align") == 0) {
+			align = 1;
+		} else if (strcmp(argv[i], "--progressive") == 0) {
+			progressive = 1;
+		} else if (strcmp(argv[i], "--watch") == 0) {
+			watch = 1;
+		} else if (strncmp(argv[i], "--export-map=", 13) == 0 &&
+		           i+1 < argc) {
+			if (parse_size(argv[i] + 13, &map_width,
+			               &map_height) != 0) {
+				printf(message[21], argv[i] + 13);
+				return 1;
+			}
+			map_path = argv[++i];
+		} else if (strcmp(argv[i], "--map-heat") == 0) {
+			map_heat = 1;
+		} else if (strcmp(argv[i], "--emit-patch") == 0 && i+1 < argc) {
+			patch_path = argv[++i];
+		} else if (strcmp(argv[i], "--apply-patch") == 0 && i+1 < argc) {
+			apply_path = argv[++i];
+		} else if (strcmp(argv[i], "--make-signature") == 0 && i+1 < argc) {
+			make_signature = argv[++i];
+		} else if (strcmp(argv[i], "--signature") == 0 && i+1 < argc) {
+			signature_name = argv[++i];
+		} else if (strcmp(argv[i], "--serve") == 0 && i+1 < argc) {
+			serve = argv[++i];
+		} else if (strcmp(argv[i], "--remote") == 0 && i+1 < argc) {
+			remote_command = argv[++i];
+		} else if (strcmp(argv[i], "--chunk-size") == 0 && i+1 < argc) {
+			chunk_size = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--range") == 0 && i+1 < argc &&
+		           parse_range(argv[i+1], &offset_one, &length) == 0) {
+			offset_two = offset_one;
+			i++;
+		} else if (strcmp(argv[i], "--offset1") == 0 && i+1 < argc) {
+			offset_one = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--offset2") == 0 && i+1 < argc) {
+			offset_two = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--length") == 0 && i+1 < argc) {
+			length = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "--mask") == 0 && i+1 < argc) {
+			mask_path = argv[++i];
+		} else if (strncmp(argv[i], "--", 2) == 0 || files == 2) {
+			printf(message[3], argv[i]);
+			return 1;
+		} else {
+			names[files++] = argv[i];
+		}
+	}
+
 	/* Verify that we have enough input arguments. */
-	if (argc < 2) {
+	if (chunk_size == 0) {
+		printf(message[3], "--chunk-size");
+		return 1;
+	}
+	if (length == 0) {
+		printf(message[3], "--length");
+		return 1;
+	}
+	ranged = offset_one != 0 || offset_two != 0 || length != FILE_WHOLE;
+	if (serve != NULL) {
+		/* Agent mode: the other end of --remote. */
+		if (file_open(&file_one, serve) != 0) {
+			fprintf(stderr, message[2], serve);
+			return 1;
+		}
+		result = file_spool(&file_one) != 0 ||
+		         remote_serve(&file_one, stdin, stdout) != 0;
+		file_close(&file_one);
+		return result;
+	}
+	if (files < 1) {
 		puts("hexcompare v" PVER "\n");
 		printf("%s%s", message[0], message[1]);
+		for (i = 0; usage_options[i] != NULL; i++)
+			printf("%s", usage_options[i]);
 		return 1;
 	}
 
-	/* Load in the file names. */
-	file_one.name = argv[1];
-	if (argc == 2) {
-		file_two.name = argv[1];
-	} else {
-		file_two.name = argv[2];
+	if (apply_path != NULL) {
+		/* Patch mode: write the differences into the file in place. */
+		if (patch_apply(apply_path, names[0]) != 0) {
+			printf(message[14], apply_path, names[0]);
+			return 1;
+		}
+		return 0;
 	}
 
 	/* Open the files.
 	   Present the user with an error message if they cannot be opened. */
-	if ((file_one.pointer = fopen(file_one.name, "rb")) == NULL) {
+	if (file_open(&file_one, names[0]) != 0) {
 		printf(message[2], file_one.name);
 		return 1;
 	}
-	if ((file_two.pointer = fopen(file_two.name, "rb")) == NULL) {
+
+	/* Signature creation only needs the first file. */
+	if (make_signature != NULL) {
+		if (file_spool(&file_one) == 0 && (!ranged ||
+		    file_window(&file_one, offset_one, length) == 0))
+			signature = signature_create(&file_one, chunk_size);
+		if (signature == NULL || signature_save(signature,
+		                                        make_signature) != 0) {
+			printf("%s", message[6]);
+			result = 1;
+		}
+		signature_free(signature);
+		file_close(&file_one);
+		return result;
+	}
+
+	/* Without a second file, a remote agent or a signature stands in for
+	   it. Otherwise compare the file against itself, as before. */
+	if (names[1] == NULL && remote_command != NULL) {
+		file_two.name = remote_command;
+		file_two.pointer = NULL;
+		file_two.signature = NULL;
+		file_two.alignment = NULL;
+		file_two.watch = NULL;
+		file_two.stream = NULL;
+		file_two.start = 0;
+		file_two.limit = FILE_WHOLE;
+		file_two.mask = NULL;
+		if ((file_two.remote = remote_launch(remote_command)) == NULL) {
+			printf(message[7], remote_command);
+			file_close(&file_one);
+			return 1;
+		}
+		file_two.size = file_two.remote->size;
+	} else if (names[1] == NULL && signature_name != NULL) {
+		file_two.name = signature_name;
+		file_two.pointer = NULL;
+		file_two.size = 0;
+		file_two.signature = NULL;
+		file_two.remote = NULL;
+		file_two.alignment = NULL;
+		file_two.watch = NULL;
+		file_two.stream = NULL;
+		file_two.start = 0;
+		file_two.limit = FILE_WHOLE;
+		file_two.mask = NULL;
+	} else if (file_open(&file_two,
+	                     names[1] != NULL ? names[1] : names[0]) != 0) {
 		printf(message[2], file_two.name);
-		fclose(file_one.pointer);
+		file_close(&file_one);
 		return 1;
 	}
 
-	/* Get the file size */
-	fseek(file_one.pointer, 0, SEEK_END);
-	file_one.size = ftell(file_one.pointer);
+	/* Streams are read to their end first, unless the report can be made
+	   in a single forward pass over them. */
+	stream_report = (report || patch_path != NULL) && find == NULL &&
+	                map_path == NULL &&
+	                signature_name == NULL &&
+	                !align && !ranged && file_two.remote == NULL &&
+	                (file_one.stream != NULL || file_two.stream != NULL);
+	if (stream_report) {
+		file_forward_only(&file_one);
+		file_forward_only(&file_two);
+	} else if (file_spool(&file_one) != 0 || file_spool(&file_two) != 0) {
+		printf("%s", message[6]);
+		result = 1;
+	}
 
-	fseek(file_two.pointer, 0, SEEK_END);
-	file_two.size = ftell(file_two.pointer);
+	/* Narrow the files down to the ranges to compare, so nothing else is
+	   read, and load the bytes to ignore within them. */
+	if (result == 0 && (ranged || mask_path != NULL) &&
+	    file_two.remote != NULL) {
+		printf("%s", message[15]);
+		result = 1;
+	}
+	if (result == 0 && ranged &&
+	    file_window(&file_one, offset_one, length) != 0) {
+		printf(message[16], file_one.name);
+		result = 1;
+	}
+	if (result == 0 && ranged && file_two.pointer != NULL &&
+	    file_window(&file_two, offset_two, length) != 0) {
+		printf(message[16], file_two.name);
+		result = 1;
+	}
+	if (result == 0 && mask_path != NULL &&
+	    (file_two.mask = mask_load(mask_path, file_one.start,
+	                               file_one.size)) == NULL) {
+		printf(message[17], mask_path);
+		result = 1;
+	}
 
-	/* Determine the largest file size */
-	largest_file_size = (file_one.size > file_two.size) ? file_one.size
-	                    : file_two.size;
+	/* Hash the first file against the signature. Only the chunks that
+	   differ need to be looked at byte by byte later on. */
+	diff_index_init(&coarse);
+	if (result == 0 && signature_name != NULL && file_two.remote == NULL) {
+		if ((signature = signature_load(signature_name)) == NULL) {
+			printf(message[4], signature_name);
+			result = 1;
+		} else if (file_two.pointer != NULL &&
+		           file_two.size != signature->size) {
+			printf(message[5], signature_name, file_two.name);
+			result = 1;
+		} else if (signature_compare(signature, &file_one,
+		                             &coarse) < 0) {
+			printf("%s", message[6]);
+			result = 1;
+		}
+		file_two.size = signature != NULL ? signature->size : 0;
+		file_two.signature = signature;
+	}
 
-	/* Initiate the GUI display. */
-	start_gui(&file_one, &file_two, largest_file_size);
+	/* Index the second file by content and look up the first one in it,
+	   so shifted regions line up again. That reads all of it, which a
+	   remote file is there to avoid. */
+	if (result == 0 && align) {
+		if (file_two.remote != NULL) {
+			printf("%s", message[20]);
+			result = 1;
+		} else if (file_two.pointer == NULL) {
+			printf("%s", message[8]);
+			result = 1;
+		} else if ((file_two.alignment = align_files(&file_one,
+		                                             &file_two)) == NULL) {
+			printf("%s", message[6]);
+			result = 1;
+		}
+	}
+
+	/* Hash both files, so later changes can be narrowed down to the
+	   chunks they touched. */
+	if (result == 0 && watch && find == NULL && !report) {
+		if (file_two.pointer == NULL || file_two.signature != NULL ||
+		    file_two.alignment != NULL || file_one.stream != NULL ||
+		    file_two.stream != NULL) {
+			printf("%s", message[10]);
+			result = 1;
+		} else if ((file_two.watch = watch_start(&file_one, &file_two,
+		                                         chunk_size)) == NULL) {
+			printf("%s", message[6]);
+			result = 1;
+		}
+	}
+
+	if (result != 0) {
+		/* Nothing to show. */
+	} else if (find != NULL) {
+		/* Search both files on all threads and list the matches. */
+		struct search *search = search_files(find, &file_one, &file_two);
+		unsigned char pattern[SEARCH_MAX_PATTERN];
+
+		if (search != NULL) {
+			search_print(search, &file_one, &file_two, stdout);
+		} else if (search_parse(find, pattern) == 0) {
+			printf(message[9], find);
+			result = 1;
+		} else {
+			printf("%s", message[6]);
+			result = 1;
+		}
+		search_free(search);
+	} else if (map_path != NULL) {
+		/* Render the overview at any resolution, without curses, through
+		   the engine the interface compares blocks with. */
+		struct hexcompare *engine = NULL;
+
+		if (file_two.pointer == NULL || file_two.alignment != NULL) {
+			printf("%s", message[11]);
+			result = 1;
+		} else if ((engine = hexcompare_attach(&file_one,
+		                                       &file_two)) == NULL ||
+		           map_export(engine, map_width, map_height, map_heat,
+		                      map_path) != 0) {
+			printf("%s", message[6]);
+			result = 1;
+		}
+		hexcompare_close(engine);
+	} else if (report || patch_path != NULL) {
+		/* Print the differing ranges instead of starting the GUI, and
+		   write them as a patch in the same pass. With only a signature,
+		   chunk granularity is the best we can do. */
+		diff_index_init(&index);
+		index.latest_only = !report;
+		if (patch_path != NULL && (file_two.alignment != NULL ||
+		    (file_two.pointer == NULL && file_two.remote == NULL))) {
+			printf("%s", message[12]);
+			result = 1;
+		} else if (patch_path != NULL && ranged) {
+			printf("%s", message[18]);
+			result = 1;
+		} else if (patch_path != NULL && file_two.mask != NULL) {
+			printf("%s", message[19]);
+			result = 1;
+		} else if (patch_path != NULL &&
+		           (index.patch = patch_create(patch_path)) == NULL) {
+			printf(message[13], patch_path);
+			result = 1;
+		} else if (file_two.alignment != NULL) {
+			align_print(file_two.alignment, file_one.start,
+			            file_two.start, stdout);
+		} else if (signature != NULL && file_two.pointer == NULL) {
+			diff_index_print(&coarse, file_one.start, file_two.start,
+			                 stdout);
+		} else if ((stream_report ?
+		            diff_index_stream(&index, &file_one, &file_two) :
+		            file_two.remote != NULL ?
+		            remote_diff(&index, &file_one, &file_two) :
+		            signature != NULL ?
+		            diff_index_refine(&index, &coarse, &file_one, &file_two) :
+		            diff_index_build(&index, &file_one, &file_two)) != 0) {
+			printf("%s", message[6]);
+			result = 1;
+		} else if (report) {
+			diff_index_print(&index, file_one.start, file_two.start,
+			                 stdout);
+		}
+		if (index.patch != NULL &&
+		    patch_finish(index.patch, file_one.size, file_two.size) != 0 &&
+		    result == 0) {
+			printf(message[13], patch_path);
+			result = 1;
+		}
+		if (index.patch != NULL && result != 0) remove(patch_path);
+		diff_index_free(&index);
+	} else {
+		/* Initiate the GUI display over an engine holding both files. */
+		struct hexcompare *engine = hexcompare_attach(&file_one, &file_two);
+
+		if (engine == NULL || start_gui(engine, progressive) != 0)
+			result = 1;
+		hexcompare_close(engine);
+	}
 
 	/* Close the files. */
-	fclose(file_one.pointer);
-	fclose(file_two.pointer);
+	diff_index_free(&coarse);
+	signature_free(signature);
+	file_close(&file_one);
+	file_close(&file_two);
+	remote_close(file_two.remote);
+	align_free(file_two.alignment);
+	watch_stop(file_two.watch);
+	mask_free(file_two.mask);
 
 	/* Clean exit. */
-	return 0;
+	return result;
 }
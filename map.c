@@ -0,0 +1,279 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map.h"
+
+/* Pixel colours, as in a terminal with the default palette. */
+static const unsigned char colour_same[3]      = {   0,   0, 205 };
+static const unsigned char colour_different[3] = { 205,   0,   0 };
+static const unsigned char colour_empty[3]     = {   0, 205, 205 };
+static const unsigned char colour_heat[3][3]   = {
+	{ 255, 215, 215 }, { 255, 135, 135 }, { 215,  95,  95 }
+};
+
+static const unsigned char *block_colour(int state, unsigned long mismatches,
+                                         unsigned long length, int heat)
+{
+	if (state == HEXCOMPARE_EMPTY) return colour_empty;
+	if (state == HEXCOMPARE_SAME) return colour_same;
+	if (!heat || mismatches == HEXCOMPARE_UNKNOWN || mismatches * 2 > length)
+		return colour_different;
+	if (mismatches * 64 <= length) return colour_heat[0];
+	if (mismatches * 8 <= length) return colour_heat[1];
+	return colour_heat[2];
+}
+
+/* PNG output, without compression: the pixels go into stored deflate
+   blocks, so rows can be written as they come. */
+struct png {
+	FILE *out;
+	uint32_t adler_a, adler_b;   /* Adler-32 of the pixel data */
+	unsigned char *chunk;        /* IDAT being assembled       */
+	size_t length;
+};
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+	uint32_t c, n, k;
+
+	for (n = 0; n < 256; n++) {
+		c = n;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? UINT32_C(0xedb88320) ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc_update(uint32_t crc, const unsigned char *data,
+                           size_t length)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++)
+		crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void put32(unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = value >> 24;
+	bytes[1] = value >> 16;
+	bytes[2] = value >> 8;
+	bytes[3] = value;
+}
+
+static int png_chunk(FILE *out, const char *type, const unsigned char *data,
+                     size_t length)
+{
+	unsigned char header[8], trailer[4];
+	uint32_t crc;
+
+	put32(header, length);
+	memcpy(header + 4, type, 4);
+	crc = crc_update(UINT32_C(0xffffffff), header + 4, 4);
+	crc = crc_update(crc, data, length);
+	put32(trailer, crc ^ UINT32_C(0xffffffff));
+
+	if (fwrite(header, 8, 1, out) != 1 ||
+	    (length > 0 && fwrite(data, length, 1, out) != 1) ||
+	    fwrite(trailer, 4, 1, out) != 1)
+		return -1;
+	return 0;
+}
+
+/* Add pixel data as stored blocks of at most 65535 bytes each. */
+static void png_store(struct png *png, const unsigned char *data,
+                      size_t length)
+{
+	size_t i;
+
+	while (length > 0) {
+		size_t count = length < 65535 ? length : 65535;
+		unsigned char *block = png->chunk + png->length;
+
+		block[0] = 0;
+		block[1] = count & 0xff;
+		block[2] = count >> 8;
+		block[3] = ~count & 0xff;
+		block[4] = (~count >> 8) & 0xff;
+		memcpy(block + 5, data, count);
+		png->length += 5 + count;
+
+		for (i = 0; i < count; i++) {
+			png->adler_a = (png->adler_a + data[i]) % 65521;
+			png->adler_b = (png->adler_b + png->adler_a) % 65521;
+		}
+		data += count;
+		length -= count;
+	}
+}
+
+static int png_begin(struct png *png, unsigned long width,
+                     unsigned long height, size_t row_bytes)
+{
+	static const unsigned char signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+	};
+	unsigned char header[13];
+
+	crc_init();
+	png->adler_a = 1;
+	png->adler_b = 0;
+	png->length = 0;
+
+	/* Room for a band of rows and their stored block headers. */
+	png->chunk = malloc(row_bytes + 5 * (row_bytes / 65535 + 1) + 8);
+	if (png->chunk == NULL) return -1;
+
+	put32(header, width);
+	put32(header + 4, height);
+	header[8] = 8;      /* Bits per channel */
+	header[9] = 2;      /* RGB */
+	header[10] = 0;     /* Deflate */
+	header[11] = 0;     /* Adaptive filtering */
+	header[12] = 0;     /* Not interlaced */
+
+	if (fwrite(signature, 8, 1, png->out) != 1 ||
+	    png_chunk(png->out, "IHDR", header, 13) != 0)
+		return -1;
+
+	/* The zlib header starts the first IDAT. */
+	png->chunk[png->length++] = 0x78;
+	png->chunk[png->length++] = 0x01;
+	return 0;
+}
+
+static int png_rows(struct png *png, const unsigned char *rows,
+                    size_t length)
+{
+	png_store(png, rows, length);
+	if (png_chunk(png->out, "IDAT", png->chunk, png->length) != 0)
+		return -1;
+	png->length = 0;
+	return 0;
+}
+
+static int png_end(struct png *png)
+{
+	unsigned char *end = png->chunk;
+
+	/* An empty final block, then the checksum. */
+	end[0] = 1;
+	end[1] = 0;
+	end[2] = 0;
+	end[3] = 0xff;
+	end[4] = 0xff;
+	put32(end + 5, (png->adler_b << 16) | png->adler_a);
+
+	if (png_chunk(png->out, "IDAT", end, 9) != 0 ||
+	    png_chunk(png->out, "IEND", NULL, 0) != 0)
+		return -1;
+	return 0;
+}
+
+int map_export(struct hexcompare *engine, unsigned long width,
+               unsigned long height, int heat, const char *path)
+{
+	struct png png;
+	unsigned long total_blocks, band_rows, row, i;
+	unsigned long *mismatches;
+	unsigned char *pixels;
+	char *states;
+	size_t row_bytes, length;
+	int is_png, result = 0;
+
+	total_blocks = width * height;
+	if (width == 0 || height == 0 || total_blocks / width != height)
+		return -1;
+
+	/* Whole rows per band, at least one. Each row of pixels starts with
+	   the PNG filter type. */
+	band_rows = MAP_BAND / width ? MAP_BAND / width : 1;
+	if (band_rows > height) band_rows = height;
+	row_bytes = 1 + width * 3;
+
+	states = malloc(band_rows * width);
+	mismatches = malloc(band_rows * width * sizeof(unsigned long));
+	pixels = malloc(band_rows * row_bytes);
+	png.out = fopen(path, "wb");
+	png.chunk = NULL;
+
+	length = strlen(path);
+	is_png = length >= 4 && strcmp(path + length - 4, ".png") == 0;
+
+	if (states == NULL || mismatches == NULL || pixels == NULL ||
+	    png.out == NULL ||
+	    (is_png ? png_begin(&png, width, height, band_rows * row_bytes)
+	     : fprintf(png.out, "P6\n%lu %lu\n255\n", width, height) < 0))
+		result = -1;
+
+	for (row = 0; row < height && result == 0; row += band_rows) {
+		unsigned long rows = height - row < band_rows ? height - row
+		                     : band_rows;
+		unsigned long first = row * width, offset, end, size;
+
+		/* Blocks are spread like the terminal overview spreads them.
+		   The pieces of a band are cut the same way, so that each of
+		   them is one block, compared by the engine. */
+		hexcompare_block_range(engine, first, total_blocks, &offset,
+		                       &size);
+		hexcompare_block_range(engine, first + rows * width - 1,
+		                       total_blocks, &end, &size);
+		end += size;
+		if (hexcompare_pieces(engine, offset, end - offset, rows * width,
+		                      states, mismatches) != 0) {
+			result = -1;
+			break;
+		}
+
+		for (i = 0; i < rows * width; i++) {
+			unsigned char *pixel = pixels + (i / width) * row_bytes + 1 +
+			                       (i % width) * 3;
+			const unsigned char *colour;
+
+			hexcompare_block_range(engine, first + i, total_blocks,
+			                       &offset, &size);
+			colour = block_colour(states[i], mismatches[i], size,
+			                      heat);
+			if (i % width == 0) pixel[-1] = 0;
+			memcpy(pixel, colour, 3);
+		}
+
+		/* PPM rows are the same, without the filter type. */
+		if (is_png) {
+			result = png_rows(&png, pixels, rows * row_bytes);
+		} else {
+			for (i = 0; i < rows && result == 0; i++)
+				if (fwrite(pixels + i * row_bytes + 1, width * 3, 1,
+				           png.out) != 1)
+					result = -1;
+		}
+	}
+
+	if (result == 0 && is_png) result = png_end(&png);
+	if (png.out != NULL && fclose(png.out) != 0) result = -1;
+	free(png.chunk);
+	free(pixels);
+	free(states);
+	free(mismatches);
+	return result;
+}
@@ -0,0 +1,35 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_MAP
+#define HEX_MAP
+
+#include <stdio.h>
+#include "hexcompare.h"
+
+#define MAP_BAND 65536          /* Blocks compared per pass of the threads */
+
+/* Render the overview as an image of width x height blocks, one pixel
+   per block, in the colours of the terminal overview. With 'heat',
+   differing blocks are shaded by the share of their bytes that differ.
+   The image is written as it is computed, a band of rows at a time, as
+   PNG if 'path' ends in ".png" and as binary PPM otherwise. Returns 0, or
+   -1 on error. */
+int map_export(struct hexcompare *engine, unsigned long width,
+               unsigned long height, int heat, const char *path);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "mask.h"
+
+static int compare_ranges(const void *a, const void *b)
+{
+	const struct mask_range *x = a, *y = b;
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/* Sort the ranges and merge those that overlap or touch. */
+static void merge_ranges(struct mask *m)
+{
+	unsigned long i, count = 0;
+
+	qsort(m->ranges, m->count, sizeof(struct mask_range), compare_ranges);
+
+	for (i = 0; i < m->count; i++) {
+		struct mask_range *range = &m->ranges[i];
+		struct mask_range *last = &m->ranges[count > 0 ? count - 1 : 0];
+
+		if (count > 0 && range->offset <= last->offset + last->length) {
+			if (range->offset + range->length > last->offset + last->length)
+				last->length = range->offset + range->length -
+				               last->offset;
+			continue;
+		}
+		m->ranges[count++] = *range;
+	}
+	m->count = count;
+}
+
+struct mask *mask_load(const char *path, unsigned long start,
+                       unsigned long size)
+{
+	struct mask *m;
+	unsigned long capacity = 0;
+	char line[256];
+	FILE *in;
+
+	if ((in = fopen(path, "r")) == NULL) return NULL;
+	if ((m = calloc(1, sizeof(*m))) == NULL) {
+		fclose(in);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		unsigned long first, last;
+		char *text = line, *end;
+
+		while (*text == ' ' || *text == '\t') text++;
+		if (*text == '#' || *text == '\n' || *text == '\r' ||
+		    *text == '\0')
+			continue;
+
+		/* "FIRST-LAST", in decimal or with 0x in hex. */
+		first = strtoul(text, &end, 0);
+		if (end == text || *end != '-') break;
+		text = end + 1;
+		last = strtoul(text, &end, 0);
+		if (end == text || last < first) break;
+
+		/* Keep the part within the compared range, counted from its
+		   start. */
+		if (size == 0 || last < start ||
+		    (first > start && first - start >= size))
+			continue;
+		first = (first > start) ? first - start : 0;
+		last = (last - start < size) ? last - start : size - 1;
+
+		if (m->count == capacity) {
+			struct mask_range *ranges;
+
+			capacity = capacity ? capacity * 2 : 64;
+			ranges = realloc(m->ranges, capacity * sizeof(*ranges));
+			if (ranges == NULL) break;
+			m->ranges = ranges;
+		}
+		m->ranges[m->count].offset = first;
+		m->ranges[m->count].length = last - first + 1;
+		m->count++;
+	}
+
+	/* Stopping before the end means a line didn't make sense. */
+	if (!feof(in)) {
+		fclose(in);
+		mask_free(m);
+		return NULL;
+	}
+	fclose(in);
+
+	merge_ranges(m);
+	return m;
+}
+
+void mask_free(struct mask *m)
+{
+	if (m == NULL) return;
+	free(m->ranges);
+	free(m);
+}
+
+/* Index of the first range that ends after 'offset', or 'count'. */
+static unsigned long first_range(struct mask *m, unsigned long offset)
+{
+	unsigned long low = 0, high = m->count;
+
+	while (low < high) {
+		unsigned long middle = low + (high - low) / 2;
+		struct mask_range *range = &m->ranges[middle];
+
+		if (range->offset + range->length <= offset) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+void mask_apply(struct mask *m, unsigned long offset,
+                const unsigned char *buffer_one, unsigned char *buffer_two,
+                size_t length)
+{
+	unsigned long i, end = offset + length;
+
+	if (m == NULL || m->count == 0 || length == 0) return;
+
+	for (i = first_range(m, offset);
+	     i < m->count && m->ranges[i].offset < end; i++) {
+		unsigned long from = m->ranges[i].offset;
+		unsigned long to = from + m->ranges[i].length;
+
+		if (from < offset) from = offset;
+		if (to > end) to = end;
+		memcpy(buffer_two + (from - offset), buffer_one + (from - offset),
+		       to - from);
+	}
+}
+
+int mask_covers(struct mask *m, unsigned long offset)
+{
+	unsigned long i;
+
+	if (m == NULL) return 0;
+	i = first_range(m, offset);
+	return i < m->count && m->ranges[i].offset <= offset;
+}
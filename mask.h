@@ -0,0 +1,56 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_MASK
+#define HEX_MASK
+
+#include <stddef.h>
+#include "general.h"
+
+struct mask_range {
+	unsigned long offset;     /* First ignored byte */
+	unsigned long length;     /* Number of bytes    */
+};
+
+/* Ranges of bytes left out of the comparison, e.g. timestamps and
+   checksums, sorted and without overlaps. */
+struct mask {
+	struct mask_range *ranges;
+	unsigned long count;
+};
+
+/* Read a mask file. Each line holds a range of offsets in the first file
+   as "FIRST-LAST", both included, so lines of a report can be used as
+   they are; anything after it, blank lines and lines starting with "#"
+   are skipped. The ranges are moved into the range of the first file
+   that is compared, which starts at 'start' and holds 'size' bytes.
+   Returns NULL on error. */
+struct mask *mask_load(const char *path, unsigned long start,
+                       unsigned long size);
+void mask_free(struct mask *m);
+
+/* Make the ignored bytes among 'length' bytes read at 'offset' compare
+   equal, by copying them from the first buffer to the second. Cheap when
+   nothing is ignored there. Does nothing without a mask. */
+void mask_apply(struct mask *m, unsigned long offset,
+                const unsigned char *buffer_one, unsigned char *buffer_two,
+                size_t length);
+
+/* Whether the byte at 'offset' is ignored. */
+int mask_covers(struct mask *m, unsigned long offset);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include "arena.h"
+#include "parallel.h"
+
+#ifndef __DJGPP__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct worker {
+	parallel_job job;
+	void *context;
+	unsigned long first;
+	unsigned long last;
+};
+
+int parallel_threads(void)
+{
+	long count = 1;
+
+#if !defined(__DJGPP__) && defined(_SC_NPROCESSORS_ONLN)
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	/* Allow the thread count to be forced, e.g. for slow disks that
+	   don't like concurrent readers. */
+	if (getenv("HEXCOMPARE_THREADS") != NULL)
+		count = atol(getenv("HEXCOMPARE_THREADS"));
+
+	if (count < 1) count = 1;
+	if (count > MAX_THREADS) count = MAX_THREADS;
+	return (int) count;
+}
+
+#ifndef __DJGPP__
+static void *worker_main(void *argument)
+{
+	struct worker *w = argument;
+	w->job(w->context, w->first, w->last);
+	return NULL;
+}
+#endif
+
+void parallel_run(unsigned long items, parallel_job job, void *context)
+{
+	parallel_run_sized(items, 0, job, context);
+}
+
+void parallel_run_sized(unsigned long items, size_t memory,
+                        parallel_job job, void *context)
+{
+#ifdef __DJGPP__
+	/* No threads on DOS: run everything in the calling thread. */
+	(void) memory;
+	job(context, 0, items);
+#else
+	struct worker workers[MAX_THREADS];
+	pthread_t threads[MAX_THREADS];
+	int started[MAX_THREADS];
+	unsigned long per_thread, first = 0;
+	int i, count = parallel_threads();
+
+	if ((unsigned long) count > items) count = (int) items;
+	if (memory > 0 && (unsigned long) count > arena_room(memory))
+		count = (int) arena_room(memory);
+	if (count <= 1) {
+		job(context, 0, items);
+		return;
+	}
+
+	/* Hand out contiguous runs. The first 'items % count' workers get
+	   one extra item, same as the overview blocks. */
+	per_thread = items / count;
+	for (i = 0; i < count; i++) {
+		workers[i].job = job;
+		workers[i].context = context;
+		workers[i].first = first;
+		first += per_thread + ((unsigned long) i < items % count ? 1 : 0);
+		workers[i].last = first;
+	}
+
+	/* Worker 0 runs in this thread. If a thread can't be created, its
+	   run is done here as well. */
+	for (i = 1; i < count; i++)
+		started[i] = pthread_create(&threads[i], NULL, worker_main,
+		                            &workers[i]) == 0;
+
+	job(context, workers[0].first, workers[0].last);
+
+	for (i = 1; i < count; i++) {
+		if (started[i]) pthread_join(threads[i], NULL);
+		else job(context, workers[i].first, workers[i].last);
+	}
+#endif
+}
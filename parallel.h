@@ -0,0 +1,41 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_PARALLEL
+#define HEX_PARALLEL
+
+#include <stddef.h>
+
+#define MAX_THREADS 64
+
+/* A job processes the items first..last-1 of a larger piece of work. Each
+   worker thread is handed one contiguous run of items. */
+typedef void (*parallel_job)(void *context, unsigned long first,
+                             unsigned long last);
+
+/* Returns how many worker threads parallel_run() will use at most. */
+int parallel_threads(void);
+
+/* Split 'items' into contiguous runs and process them on worker threads.
+   Returns once every run has completed. */
+void parallel_run(unsigned long items, parallel_job job, void *context);
+
+/* Like parallel_run(), for jobs whose workers each take 'memory' bytes
+   from the arena: no more workers are started than its budget feeds. */
+void parallel_run_sized(unsigned long items, size_t memory,
+                        parallel_job job, void *context);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patch.h"
+#include "arena.h"
+#include "hash.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef __DJGPP__
+#include <errno.h>
+#endif
+
+/* DOS opens files in text mode unless told otherwise. */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static int put_number(FILE *out, unsigned long value)
+{
+	do {
+		unsigned char byte = value & 0x7f;
+		value >>= 7;
+		if (value != 0) byte |= 0x80;
+		if (putc(byte, out) == EOF) return -1;
+	} while (value != 0);
+	return 0;
+}
+
+static int get_number(FILE *in, unsigned long *value)
+{
+	int byte, shift = 0;
+
+	*value = 0;
+	do {
+		if ((byte = getc(in)) == EOF ||
+		    shift >= (int) sizeof(unsigned long) * 8)
+			return -1;
+		*value |= (unsigned long) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return 0;
+}
+
+struct patch *patch_create(const char *path)
+{
+	struct patch *patch = calloc(1, sizeof(*patch));
+
+	if (patch == NULL) return NULL;
+	if ((patch->out = fopen(path, "wb")) == NULL ||
+	    fwrite(PATCH_MAGIC, 8, 1, patch->out) != 1) {
+		if (patch->out != NULL) fclose(patch->out);
+		free(patch);
+		return NULL;
+	}
+	return patch;
+}
+
+int patch_write(struct patch *patch, unsigned long offset,
+                const unsigned char *bytes, size_t length)
+{
+	if (length == 0) return 0;
+	if (put_number(patch->out, offset - patch->end) != 0 ||
+	    put_number(patch->out, length) != 0 ||
+	    fwrite(bytes, length, 1, patch->out) != 1)
+		return -1;
+	patch->end = offset + length;
+	return 0;
+}
+
+int patch_finish(struct patch *patch, unsigned long old_size,
+                 unsigned long new_size)
+{
+	unsigned char sizes[16];
+	int result = 0;
+
+	hash_store(sizes, old_size);
+	hash_store(sizes + 8, new_size);
+	if (put_number(patch->out, 0) != 0 || put_number(patch->out, 0) != 0 ||
+	    fwrite(sizes, 16, 1, patch->out) != 1)
+		result = -1;
+	if (fclose(patch->out) != 0) result = -1;
+	free(patch);
+	return result;
+}
+
+/* Write all of a buffer at an offset of the target. */
+static int write_at(int fd, const unsigned char *bytes, size_t length,
+                    unsigned long offset)
+{
+	size_t done = 0;
+
+#ifdef __DJGPP__
+	if (lseek(fd, offset, SEEK_SET) == (off_t) -1) return -1;
+#endif
+	while (done < length) {
+#ifdef __DJGPP__
+		int result = write(fd, bytes + done, length - done);
+#else
+		ssize_t result = pwrite(fd, bytes + done, length - done,
+		                        (off_t) (offset + done));
+		if (result < 0 && errno == EINTR) continue;
+#endif
+		if (result <= 0) return -1;
+		done += result;
+	}
+	return 0;
+}
+
+int patch_apply(const char *path, const char *target)
+{
+	unsigned char magic[8], sizes[16], *buffer;
+	unsigned long offset = 0, skip, length;
+	FILE *in;
+	int fd, result = 0, regular;
+	off_t target_size;
+	struct stat status;
+
+	if ((in = fopen(path, "rb")) == NULL) return -1;
+	if ((fd = open(target, O_WRONLY | O_BINARY)) < 0) {
+		fclose(in);
+		return -1;
+	}
+
+	/* Check the sizes at the end before touching anything. A device
+	   can't change its size, so there it has to stay the same. */
+	if (fread(magic, 8, 1, in) != 1 || memcmp(magic, PATCH_MAGIC, 8) != 0 ||
+	    fseek(in, -16, SEEK_END) != 0 || fread(sizes, 16, 1, in) != 1 ||
+	    fstat(fd, &status) != 0 ||
+	    (target_size = lseek(fd, 0, SEEK_END)) == (off_t) -1 ||
+	    (uint64_t) target_size != hash_load(sizes) ||
+	    (!(regular = S_ISREG(status.st_mode)) &&
+	     hash_load(sizes + 8) != hash_load(sizes)) ||
+	    fseek(in, 8, SEEK_SET) != 0) {
+		fclose(in);
+		close(fd);
+		return -1;
+	}
+
+	buffer = arena_get(PATCH_BUFFER);
+	if (buffer == NULL) result = -1;
+
+	while (result == 0) {
+		if (get_number(in, &skip) != 0 || get_number(in, &length) != 0) {
+			result = -1;
+			break;
+		}
+		if (skip == 0 && length == 0) break;
+		offset += skip;
+
+		/* Copy the record over in pieces. */
+		while (length > 0 && result == 0) {
+			size_t count = length < PATCH_BUFFER ? length : PATCH_BUFFER;
+			if (fread(buffer, count, 1, in) != 1 ||
+			    write_at(fd, buffer, count, offset) != 0)
+				result = -1;
+			offset += count;
+			length -= count;
+		}
+	}
+
+	/* Cut off or extend to the new size. */
+	if (result == 0 && regular &&
+	    ftruncate(fd, (off_t) hash_load(sizes + 8)) != 0)
+		result = -1;
+
+	arena_put(buffer);
+	fclose(in);
+	if (close(fd) != 0) result = -1;
+	return result;
+}
@@ -0,0 +1,53 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_PATCH
+#define HEX_PATCH
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define PATCH_MAGIC "HXCPAT1"   /* 8 bytes with the terminator */
+#define PATCH_GAP 16            /* Equal bytes worth including in a record */
+#define PATCH_BUFFER 65536
+
+/* A patch that turns the first file into the second one. After the magic
+   come records of a skip (bytes since the end of the previous record)
+   and a length, both as LEB128 numbers, followed by the bytes to write.
+   A record with skip and length 0 ends the list, followed by the old and
+   the new file size as 64-bit little-endian numbers. */
+struct patch {
+	FILE *out;
+	unsigned long end;      /* Where the last record ended */
+};
+
+struct patch *patch_create(const char *path);
+
+/* Add a record. Records must come in increasing order. */
+int patch_write(struct patch *patch, unsigned long offset,
+                const unsigned char *bytes, size_t length);
+
+/* End the patch with the sizes of both files, and close it. Returns 0,
+   or -1 if anything failed to be written. */
+int patch_finish(struct patch *patch, unsigned long old_size,
+                 unsigned long new_size);
+
+/* Apply a patch to the file at 'target', in place. The file must have the
+   size of the first file. Returns 0, or -1 on error. */
+int patch_apply(const char *path, const char *target);
+
+#endif
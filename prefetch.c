@@ -0,0 +1,189 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+#include "arena.h"
+#include "fileio.h"
+
+struct prefetch *prefetch_create(struct file *file_one,
+                                 struct file *file_two)
+{
+	struct prefetch *p = calloc(1, sizeof(*p));
+	int i;
+
+	if (p == NULL) return NULL;
+	p->memory = arena_get(PREFETCH_PAGES * PREFETCH_PAGE_SIZE);
+	if (p->memory == NULL) {
+		free(p);
+		return NULL;
+	}
+	for (i = 0; i < PREFETCH_PAGES; i++)
+		p->pages[i].data = p->memory + i * PREFETCH_PAGE_SIZE;
+
+	p->files[0] = file_one;
+	p->files[1] = file_two;
+	return p;
+}
+
+void prefetch_free(struct prefetch *p)
+{
+	if (p == NULL) return;
+	arena_put(p->memory);
+	free(p);
+}
+
+/* Find the cached page of file 'side' holding 'offset'. If it isn't there
+   and 'fill' is set, read it into the least recently used slot. */
+static struct prefetch_page *find_page(struct prefetch *p, int side,
+                                       unsigned long offset, int fill)
+{
+	struct prefetch_page *page = &p->pages[0];
+	int i;
+
+	offset -= offset % PREFETCH_PAGE_SIZE;
+
+	for (i = 0; i < PREFETCH_PAGES; i++) {
+		if (p->pages[i].used != 0 && p->pages[i].side == side &&
+		    p->pages[i].offset == offset) {
+			p->pages[i].used = ++p->clock;
+			return &p->pages[i];
+		}
+		if (p->pages[i].used < page->used) page = &p->pages[i];
+	}
+	if (!fill) return NULL;
+
+	page->side = side;
+	page->offset = offset;
+	page->length = file_read_at(p->files[side], page->data,
+	                            PREFETCH_PAGE_SIZE, offset);
+	page->used = ++p->clock;
+	return page;
+}
+
+size_t prefetch_read(struct prefetch *p, int side, void *buffer,
+                     size_t length, unsigned long offset)
+{
+	size_t done = 0;
+
+	while (done < length) {
+		struct prefetch_page *page = find_page(p, side, offset + done, 1);
+		size_t skip = offset + done - page->offset, count;
+
+		if (skip >= page->length) break;
+		count = page->length - skip;
+		if (count > length - done) count = length - done;
+		memcpy((unsigned char *) buffer + done, page->data + skip, count);
+		done += count;
+	}
+
+	return done;
+}
+
+/* Find where the 'k'th screen ahead of the view starts in file 'side'.
+   Screens are a move apart, or adjacent when the moves are shorter than a
+   screen. Returns -1 when it lies outside the file. */
+static int screen_ahead(struct prefetch *p, int side, int k,
+                        unsigned long *start)
+{
+	unsigned long distance = labs(p->step);
+	unsigned long offset = p->offset[side];
+
+	if (distance < p->screen) distance = p->screen;
+	distance *= k;
+
+	if (p->step < 0) {
+		if (offset == 0) return -1;
+		*start = (distance > offset) ? 0 : offset - distance;
+	} else {
+		*start = offset + distance;
+		if (*start < offset || *start >= p->files[side]->size) return -1;
+	}
+	return 0;
+}
+
+void prefetch_moved(struct prefetch *p, unsigned long offset_one,
+                    unsigned long offset_two, unsigned long screen)
+{
+	long delta = (long) (offset_one - p->offset[0]);
+	unsigned long start;
+	int side, k;
+
+	if (delta == 0 && screen == p->screen) return;
+
+	/* Average the moves in one direction, so that holding a key down
+	   looks further ahead than a single jump; turning around starts
+	   afresh. */
+	if (p->step == 0 || (delta < 0) != (p->step < 0))
+		p->step = delta;
+	else
+		p->step = p->step / 2 + delta / 2;
+
+	p->offset[0] = offset_one;
+	p->offset[1] = offset_two;
+	p->screen = screen;
+	p->pending = 1;
+	p->loaded = 0;
+
+	/* Let the system start on the screens ahead right away, the cache
+	   picks them up later. */
+	for (k = 1; k <= PREFETCH_SCREENS; k++)
+		for (side = 0; side < 2; side++)
+			if (screen_ahead(p, side, k, &start) == 0)
+				file_advise(p->files[side], start, screen);
+}
+
+int prefetch_step(struct prefetch *p)
+{
+	unsigned long start, offset;
+	int side, k;
+
+	/* Leave room in the cache for the screen that is shown. */
+	if (!p->pending || p->loaded >= PREFETCH_PAGES / 2) {
+		p->pending = 0;
+		return 0;
+	}
+
+	for (k = 1; k <= PREFETCH_SCREENS; k++) {
+		for (side = 0; side < 2; side++) {
+			if (screen_ahead(p, side, k, &start) != 0) continue;
+
+			offset = start - start % PREFETCH_PAGE_SIZE;
+			for (; offset < start + p->screen &&
+			       offset < p->files[side]->size;
+			     offset += PREFETCH_PAGE_SIZE) {
+				if (find_page(p, side, offset, 0) != NULL) continue;
+				find_page(p, side, offset, 1);
+				p->loaded++;
+				return 1;
+			}
+		}
+	}
+
+	p->pending = 0;
+	return 0;
+}
+
+void prefetch_drop(struct prefetch *p)
+{
+	int i;
+
+	for (i = 0; i < PREFETCH_PAGES; i++) p->pages[i].used = 0;
+	p->pending = 1;
+	p->loaded = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_PREFETCH
+#define HEX_PREFETCH
+
+#include <stddef.h>
+#include "general.h"
+
+#define PREFETCH_PAGE_SIZE 4096
+#define PREFETCH_PAGES 64       /* Pages cached, for both files together */
+#define PREFETCH_SCREENS 4      /* Screens read ahead of the view        */
+
+struct prefetch_page {
+	int side;               /* 0 for the first file, 1 for the second */
+	unsigned long offset;   /* File offset of the page                */
+	size_t length;          /* Valid bytes, short at EOF              */
+	unsigned long used;     /* Last use for LRU replacement, 0 = free */
+	unsigned char *data;    /* PREFETCH_PAGE_SIZE bytes, page-aligned */
+};
+
+/* Pages of both files around what the hex view shows. The view reports
+   where it is after every move; from how far and which way it went, the
+   next few screens in that direction are requested from the system at
+   once, and read into the cache whenever the interface is idle. */
+struct prefetch {
+	struct file *files[2];
+	unsigned long clock;        /* Use counter for the page cache         */
+	unsigned long offset[2];    /* Where the view last was, in each file  */
+	unsigned long screen;       /* Bytes on one screen                    */
+	long step;                  /* Smoothed move, negative going back     */
+	int pending;                /* Pages ahead may still be missing       */
+	int loaded;                 /* Pages read ahead since the last move   */
+	unsigned char *memory;      /* All pages, from the arena              */
+	struct prefetch_page pages[PREFETCH_PAGES];
+};
+
+struct prefetch *prefetch_create(struct file *file_one,
+                                 struct file *file_two);
+void prefetch_free(struct prefetch *p);
+
+/* Read like file_read_at() from file 'side' (0 or 1), through the cache. */
+size_t prefetch_read(struct prefetch *p, int side, void *buffer,
+                     size_t length, unsigned long offset);
+
+/* The view now starts at 'offset_one' in the first file and at
+   'offset_two' in the second, and shows 'screen' bytes. */
+void prefetch_moved(struct prefetch *p, unsigned long offset_one,
+                    unsigned long offset_two, unsigned long screen);
+
+/* Read one of the pages ahead of the view into the cache. Returns 1 if
+   there may be more to read, 0 once all of them are in. */
+int prefetch_step(struct prefetch *p);
+
+/* Forget all cached pages, e.g. after the files changed. */
+void prefetch_drop(struct prefetch *p);
+
+#endif
@@ -0,0 +1,507 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "remote.h"
+#include "arena.h"
+#include "fileio.h"
+#include "hash.h"
+#include "parallel.h"
+
+#ifndef __DJGPP__
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define PIECE_SIZE 65536        /* Unit of the chained part hash      */
+#define REMOTE_FANOUT 16        /* Parts per range when narrowing     */
+#define REMOTE_LEAF 4096        /* Ranges this small are fetched      */
+#define REMOTE_BATCH 64         /* Requests in flight while narrowing */
+
+/* #####################################################################
+   ##                        PART HASHING                             ##
+   ##################################################################### */
+
+/* Locate part i of a range split into 'parts', the first 'length % parts'
+   parts being one byte longer, like the overview blocks. */
+static void part_range(unsigned long offset, unsigned long length,
+                       unsigned long parts, unsigned long i,
+                       unsigned long *part_offset, unsigned long *part_length)
+{
+	unsigned long base = length / parts, excess = length % parts;
+
+	*part_offset = offset + i * base + (i < excess ? i : excess);
+	*part_length = base + (i < excess ? 1 : 0);
+}
+
+struct part_job {
+	struct file *f;
+	unsigned long offset;
+	unsigned long length;
+	unsigned long parts;
+	uint64_t *hashes;
+	int failed;
+};
+
+/* A part is hashed in pieces, each piece seeded with the hash of the one
+   before, so that parts of any size can be hashed in constant memory.
+   Bytes past the end of the file are not part of the hash. */
+static void hash_parts_job(void *context, unsigned long first,
+                           unsigned long last)
+{
+	struct part_job *job = context;
+	unsigned char *buffer;
+	unsigned long i;
+
+	if ((buffer = arena_get(PIECE_SIZE)) == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	for (i = first; i < last && !job->failed; i++) {
+		unsigned long offset, length;
+		uint64_t h = 0;
+
+		part_range(job->offset, job->length, job->parts, i, &offset,
+		           &length);
+		if (offset >= job->f->size) length = 0;
+		else if (job->f->size - offset < length)
+			length = job->f->size - offset;
+
+		while (length > 0) {
+			size_t count = length < PIECE_SIZE ? length : PIECE_SIZE;
+			if (file_read_at(job->f, buffer, count, offset) != count) {
+				job->failed = 1;
+				break;
+			}
+			h = hash64(buffer, count, h);
+			offset += count;
+			length -= count;
+		}
+		job->hashes[i] = h;
+	}
+
+	arena_put(buffer);
+}
+
+static int hash_parts(struct file *f, unsigned long offset,
+                      unsigned long length, unsigned long parts,
+                      uint64_t *hashes)
+{
+	struct part_job job;
+
+	job.f = f;
+	job.offset = offset;
+	job.length = length;
+	job.parts = parts;
+	job.hashes = hashes;
+	job.failed = 0;
+
+	parallel_run_sized(parts, PIECE_SIZE, hash_parts_job, &job);
+	return job.failed ? -1 : 0;
+}
+
+/* #####################################################################
+   ##                         CLIENT END                              ##
+   ##################################################################### */
+
+/* Read a reply line "<keyword> <number>". */
+static int read_reply(FILE *in, const char *keyword, unsigned long *value)
+{
+	char line[256], word[16];
+
+	if (fgets(line, sizeof(line), in) == NULL) return -1;
+	if (sscanf(line, "%15s %lu", word, value) != 2) return -1;
+	return strcmp(word, keyword) == 0 ? 0 : -1;
+}
+
+struct remote *remote_attach(FILE *in, FILE *out)
+{
+	struct remote *r = calloc(1, sizeof(*r));
+
+	/* Agree on the protocol version and hash before anything else. */
+	if (r != NULL) {
+		r->in = in;
+		r->out = out;
+		fprintf(out, "HELLO %d xxh64\n", REMOTE_VERSION);
+		if (fflush(out) == 0 && read_reply(in, "OK", &r->size) == 0)
+			return r;
+		free(r);
+	}
+
+	fclose(in);
+	fclose(out);
+	return NULL;
+}
+
+struct remote *remote_launch(const char *command)
+{
+#ifdef __DJGPP__
+	(void) command;
+	return NULL;
+#else
+	struct remote *r;
+	FILE *in, *out;
+	int sv[2], fd;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return NULL;
+
+	/* A dying agent should show up as a failed request, not kill us. */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((pid = fork()) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return NULL;
+	}
+	if (pid == 0) {
+		dup2(sv[1], 0);
+		dup2(sv[1], 1);
+		close(sv[0]);
+		close(sv[1]);
+		execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+		_exit(127);
+	}
+	close(sv[1]);
+
+	in = fdopen(sv[0], "rb");
+	out = (fd = dup(sv[0])) >= 0 ? fdopen(fd, "wb") : NULL;
+	if (in == NULL || out == NULL) {
+		if (in != NULL) fclose(in); else close(sv[0]);
+		if (out != NULL) fclose(out); else if (fd >= 0) close(fd);
+		waitpid(pid, NULL, 0);
+		return NULL;
+	}
+
+	if ((r = remote_attach(in, out)) == NULL) {
+		waitpid(pid, NULL, 0);
+		return NULL;
+	}
+	r->pid = pid;
+	return r;
+#endif
+}
+
+void remote_close(struct remote *r)
+{
+	if (r == NULL) return;
+
+	fprintf(r->out, "QUIT\n");
+	fclose(r->out);
+	fclose(r->in);
+#ifndef __DJGPP__
+	if (r->pid != 0) waitpid((pid_t) r->pid, NULL, 0);
+#endif
+	free(r);
+}
+
+/* Transfer bytes with READ requests, bypassing the cache. */
+static size_t fetch(struct remote *r, unsigned char *buffer, size_t length,
+                    unsigned long offset)
+{
+	size_t done = 0;
+	unsigned long count;
+
+	while (done < length) {
+		size_t wanted = length - done;
+		if (wanted > REMOTE_MAX_READ) wanted = REMOTE_MAX_READ;
+
+		fprintf(r->out, "READ %lu %lu\n", offset + done,
+		        (unsigned long) wanted);
+		if (fflush(r->out) != 0 ||
+		    read_reply(r->in, "DATA", &count) != 0 || count > wanted ||
+		    fread(buffer + done, 1, count, r->in) != count)
+			break;
+
+		done += count;
+		if (count < wanted) break;
+	}
+
+	return done;
+}
+
+/* Find the cached page holding 'offset', fetching it into the least
+   recently used slot if it isn't there. */
+static struct remote_page *find_page(struct remote *r, unsigned long offset)
+{
+	struct remote_page *page = &r->pages[0];
+	int i;
+
+	offset -= offset % REMOTE_PAGE_SIZE;
+
+	for (i = 0; i < REMOTE_PAGES; i++) {
+		if (r->pages[i].used != 0 && r->pages[i].offset == offset) {
+			r->pages[i].used = ++r->clock;
+			return &r->pages[i];
+		}
+		if (r->pages[i].used < page->used) page = &r->pages[i];
+	}
+
+	page->offset = offset;
+	page->length = fetch(r, page->data, REMOTE_PAGE_SIZE, offset);
+	page->used = page->length > 0 ? ++r->clock : 0;
+	return page->length > 0 ? page : NULL;
+}
+
+size_t remote_read(struct remote *r, void *buffer, size_t length,
+                   unsigned long offset)
+{
+	size_t done = 0;
+
+	if (offset >= r->size) return 0;
+	if (r->size - offset < length) length = r->size - offset;
+
+	/* Large reads, e.g. from the report, gain nothing from the cache. */
+	if (length > REMOTE_PAGE_SIZE * 4)
+		return fetch(r, buffer, length, offset);
+
+	while (done < length) {
+		struct remote_page *page = find_page(r, offset + done);
+		size_t skip, count;
+
+		if (page == NULL) break;
+		skip = offset + done - page->offset;
+		if (skip >= page->length) break;
+
+		count = page->length - skip;
+		if (count > length - done) count = length - done;
+		memcpy((unsigned char *) buffer + done, page->data + skip, count);
+		done += count;
+	}
+
+	return done;
+}
+
+static void request_hashes(struct remote *r, unsigned long offset,
+                           unsigned long length, unsigned long parts)
+{
+	fprintf(r->out, "HASH %lu %lu %lu\n", offset, length, parts);
+}
+
+/* Hash the local side of a range while the agent works on its side, then
+   compare against the agent's reply. The reply is always consumed so the
+   connection stays in step. */
+static int finish_compare(struct remote *r, struct file *local,
+                          unsigned long offset, unsigned long length,
+                          unsigned long parts, char *differs)
+{
+	uint64_t *hashes;
+	unsigned char bytes[8];
+	unsigned long count, i;
+	int result;
+
+	hashes = arena_get(parts * sizeof(uint64_t));
+	result = hashes != NULL ? hash_parts(local, offset, length, parts,
+	                                     hashes) : -1;
+
+	if (read_reply(r->in, "HASHES", &count) != 0 || count != parts) {
+		arena_put(hashes);
+		return -1;
+	}
+	for (i = 0; i < parts; i++) {
+		if (fread(bytes, 8, 1, r->in) != 1) {
+			result = -1;
+			break;
+		}
+		if (result == 0) differs[i] = hash_load(bytes) != hashes[i];
+	}
+
+	arena_put(hashes);
+	return result;
+}
+
+int remote_compare_parts(struct remote *r, struct file *local,
+                         unsigned long offset, unsigned long length,
+                         unsigned long parts, char *differs)
+{
+	if (parts == 0 || parts > REMOTE_MAX_PARTS) return -1;
+
+	request_hashes(r, offset, length, parts);
+	if (fflush(r->out) != 0) return -1;
+
+	return finish_compare(r, local, offset, length, parts, differs);
+}
+
+/* Append to a work list without merging neighbours. */
+static int push_range(struct diff_index *list, unsigned long offset,
+                      unsigned long length)
+{
+	if (list->count == list->capacity) {
+		unsigned long capacity = list->capacity ? list->capacity * 2 : 64;
+		struct diff_range *ranges = realloc(list->ranges,
+		                               capacity * sizeof(*ranges));
+		if (ranges == NULL) return -1;
+		list->ranges = ranges;
+		list->capacity = capacity;
+	}
+
+	list->ranges[list->count].offset = offset;
+	list->ranges[list->count].length = length;
+	list->count++;
+	return 0;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+	const struct diff_range *x = a, *y = b;
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+int remote_diff(struct diff_index *index, struct file *local,
+                struct file *remote_file)
+{
+	struct remote *r = remote_file->remote;
+	struct diff_index current, next, leaves, coarse;
+	unsigned long common_size, i, j, k;
+	char differs[REMOTE_FANOUT];
+	int result = 0;
+
+	diff_index_init(&current);
+	diff_index_init(&leaves);
+	diff_index_init(&coarse);
+
+	common_size = (local->size < remote_file->size) ? local->size
+	              : remote_file->size;
+	if (common_size > 0) result = push_range(&current, 0, common_size);
+
+	/* Narrow down level by level. Each level's requests are sent in
+	   batches so the round trips overlap with the hashing. */
+	while (current.count > 0 && result == 0) {
+		diff_index_init(&next);
+
+		for (i = 0; i < current.count && result == 0; i += REMOTE_BATCH) {
+			unsigned long batch = current.count - i;
+			if (batch > REMOTE_BATCH) batch = REMOTE_BATCH;
+
+			for (j = i; j < i + batch; j++)
+				if (current.ranges[j].length > REMOTE_LEAF)
+					request_hashes(r, current.ranges[j].offset,
+					               current.ranges[j].length, REMOTE_FANOUT);
+			if (fflush(r->out) != 0) result = -1;
+
+			for (j = i; j < i + batch && result == 0; j++) {
+				struct diff_range *range = &current.ranges[j];
+
+				if (range->length <= REMOTE_LEAF) {
+					result = push_range(&leaves, range->offset,
+					                    range->length);
+					continue;
+				}
+
+				result = finish_compare(r, local, range->offset,
+				                        range->length, REMOTE_FANOUT,
+				                        differs);
+				for (k = 0; k < REMOTE_FANOUT && result == 0; k++) {
+					unsigned long offset, length;
+
+					if (!differs[k]) continue;
+					part_range(range->offset, range->length,
+					           REMOTE_FANOUT, k, &offset, &length);
+					result = push_range(&next, offset, length);
+				}
+			}
+		}
+
+		diff_index_free(&current);
+		current = next;
+	}
+
+	/* Leaves come out of different levels, so sort them, then fetch and
+	   compare only those bytes. */
+	if (result == 0) {
+		qsort(leaves.ranges, leaves.count, sizeof(struct diff_range),
+		      compare_offsets);
+		for (i = 0; i < leaves.count && result == 0; i++)
+			result = diff_index_add_counted(&coarse,
+			                                leaves.ranges[i].offset,
+			                                leaves.ranges[i].length, 0);
+	}
+	if (result == 0)
+		result = diff_index_refine(index, &coarse, local, remote_file);
+
+	diff_index_free(&current);
+	diff_index_free(&leaves);
+	diff_index_free(&coarse);
+	return result;
+}
+
+/* #####################################################################
+   ##                          AGENT END                              ##
+   ##################################################################### */
+
+int remote_serve(struct file *f, FILE *in, FILE *out)
+{
+	char line[256], word[16], hash_name[16];
+	unsigned long a, b, c, i;
+	unsigned char bytes[8];
+
+	/* Handshake: both ends must speak the same version and hash. */
+	if (fgets(line, sizeof(line), in) == NULL ||
+	    sscanf(line, "%15s %lu %15s", word, &a, hash_name) != 3 ||
+	    strcmp(word, "HELLO") != 0 || a != REMOTE_VERSION ||
+	    strcmp(hash_name, "xxh64") != 0) {
+		fprintf(out, "ERR unsupported protocol\n");
+		fflush(out);
+		return -1;
+	}
+	fprintf(out, "OK %lu\n", f->size);
+	fflush(out);
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		int fields = sscanf(line, "%15s %lu %lu %lu", word, &a, &b, &c);
+
+		if (fields >= 1 && strcmp(word, "QUIT") == 0) break;
+
+		if (fields == 4 && strcmp(word, "HASH") == 0 && c > 0 &&
+		    c <= REMOTE_MAX_PARTS && b <= (unsigned long) -1 - a) {
+			uint64_t *hashes = arena_get(c * sizeof(uint64_t));
+
+			if (hashes == NULL || hash_parts(f, a, b, c, hashes) != 0) {
+				fprintf(out, "ERR read failed\n");
+			} else {
+				fprintf(out, "HASHES %lu\n", c);
+				for (i = 0; i < c; i++) {
+					hash_store(bytes, hashes[i]);
+					fwrite(bytes, 8, 1, out);
+				}
+			}
+			arena_put(hashes);
+		} else if (fields == 3 && strcmp(word, "READ") == 0 &&
+		           b <= REMOTE_MAX_READ) {
+			unsigned char *buffer = arena_get(b);
+
+			if (buffer == NULL) {
+				fprintf(out, "ERR out of memory\n");
+			} else {
+				size_t count = file_read_at(f, buffer, b, a);
+				fprintf(out, "DATA %lu\n", (unsigned long) count);
+				fwrite(buffer, 1, count, out);
+			}
+			arena_put(buffer);
+		} else {
+			fprintf(out, "ERR bad request\n");
+		}
+
+		if (fflush(out) != 0) return -1;
+	}
+
+	return 0;
+}
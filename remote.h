@@ -0,0 +1,87 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_REMOTE
+#define HEX_REMOTE
+
+#include <stdio.h>
+#include <stdint.h>
+#include "general.h"
+#include "diff.h"
+
+/* The remote protocol lets hexcompare look at a file on another machine
+   through any byte pipe, e.g. ssh. The agent ("hexcompare --serve FILE")
+   answers requests on stdin/stdout:
+
+     client: HELLO 1 xxh64               server: OK <size> | ERR <reason>
+     client: HASH <offset> <length> <n>  server: HASHES <n> + n*8 bytes
+     client: READ <offset> <length>      server: DATA <n> + n bytes
+     client: QUIT
+
+   HASH splits the range into n parts the same way the overview splits a
+   file into blocks, and hashes each part with part_hash(). Numbers are
+   decimal, hashes are little-endian. Raw bytes only travel for READ. */
+
+#define REMOTE_VERSION 1
+#define REMOTE_MAX_PARTS 1048576
+#define REMOTE_MAX_READ 16777216
+#define REMOTE_PAGE_SIZE 4096
+#define REMOTE_PAGES 64
+
+struct remote_page {
+	unsigned long offset;   /* File offset of the page        */
+	size_t length;          /* Valid bytes, short at EOF      */
+	unsigned long used;     /* Last use, for LRU replacement  */
+	unsigned char data[REMOTE_PAGE_SIZE];
+};
+
+/* Client end of a connection. Not thread-safe. */
+struct remote {
+	FILE *in;                 /* Replies from the agent           */
+	FILE *out;                /* Requests to the agent            */
+	long pid;                 /* Agent process, or 0 if not ours  */
+	unsigned long size;       /* Size of the remote file          */
+	unsigned long clock;      /* Use counter for the page cache   */
+	struct remote_page pages[REMOTE_PAGES];
+};
+
+/* Run 'command' through the shell with its stdin/stdout connected to a
+   socketpair, and talk to it. */
+struct remote *remote_launch(const char *command);
+
+/* Talk to an agent over an existing pair of streams. */
+struct remote *remote_attach(FILE *in, FILE *out);
+void remote_close(struct remote *r);
+
+/* Read bytes of the remote file, through a small page cache. */
+size_t remote_read(struct remote *r, void *buffer, size_t length,
+                   unsigned long offset);
+
+/* Split a range into 'parts' like the overview blocks, and tell for each
+   part whether the local and remote data differ. Only hashes travel. */
+int remote_compare_parts(struct remote *r, struct file *local,
+                         unsigned long offset, unsigned long length,
+                         unsigned long parts, char *differs);
+
+/* Build an exact diff index by narrowing down differing ranges with
+   hashes, then transferring only the bytes of the ranges left over. */
+int remote_diff(struct diff_index *index, struct file *local,
+                struct file *remote_file);
+
+/* Answer requests for 'f' until QUIT or end of input. */
+int remote_serve(struct file *f, FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "arena.h"
+#include "fileio.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Matches found in one segment of a file. */
+struct match_list {
+	unsigned long *offsets;
+	unsigned long count;
+	unsigned long capacity;
+};
+
+struct search_job {
+	struct file *f;
+	const unsigned char *pattern;
+	size_t length;
+	struct match_list *lists;       /* One per segment */
+	int failed;
+};
+
+size_t search_parse(const char *text, unsigned char *pattern)
+{
+	size_t length = 0;
+
+	if (text[0] != '0' || (text[1] != 'x' && text[1] != 'X')) {
+		length = strlen(text);
+		if (length > SEARCH_MAX_PATTERN) return 0;
+		memcpy(pattern, text, length);
+		return length;
+	}
+
+	/* Hex digits, two per byte, with optional spaces between bytes. */
+	for (text += 2; *text != '\0'; text++) {
+		char digits[3];
+
+		if (*text == ' ') continue;
+		if (!isxdigit((unsigned char) text[0]) ||
+		    !isxdigit((unsigned char) text[1]) ||
+		    length == SEARCH_MAX_PATTERN)
+			return 0;
+		digits[0] = text[0];
+		digits[1] = text[1];
+		digits[2] = '\0';
+		pattern[length++] = (unsigned char) strtoul(digits, NULL, 16);
+		text++;
+	}
+
+	return length;
+}
+
+static int add_match(struct match_list *list, unsigned long offset)
+{
+	if (list->count == list->capacity) {
+		unsigned long capacity = list->capacity ? list->capacity * 2 : 16;
+		unsigned long *offsets = realloc(list->offsets,
+		                                 capacity * sizeof(*offsets));
+		if (offsets == NULL) return -1;
+		list->offsets = offsets;
+		list->capacity = capacity;
+	}
+	list->offsets[list->count++] = offset;
+	return 0;
+}
+
+/* Record every match starting before 'limit'. The buffer holds 'available'
+   bytes, which includes the first length-1 bytes after the limit so that
+   matches straddling the segment boundary are found. */
+static int scan(const unsigned char *buffer, size_t available, size_t limit,
+                const unsigned char *pattern, size_t length,
+                unsigned long base, struct match_list *list)
+{
+	size_t i = 0, end;
+
+	if (available < length) return 0;
+	end = available - length + 1;
+	if (end > limit) end = limit;
+
+#ifdef __SSE2__
+	/* Filter 16 positions at a time on the first two bytes, then check
+	   the rest of the pattern at the positions that pass. */
+	if (length >= 2) {
+		__m128i first = _mm_set1_epi8((char) pattern[0]);
+		__m128i second = _mm_set1_epi8((char) pattern[1]);
+
+		for (; i + 16 <= end; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (buffer + i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (buffer + i + 1));
+			unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+			                    _mm_cmpeq_epi8(a, first),
+			                    _mm_cmpeq_epi8(b, second)));
+
+			while (mask != 0) {
+				size_t p = i + __builtin_ctz(mask);
+				if (memcmp(buffer + p + 2, pattern + 2, length - 2) == 0 &&
+				    add_match(list, base + p) != 0)
+					return -1;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	/* Whatever is left, or everything without SSE2. */
+	while (i < end) {
+		const unsigned char *p = memchr(buffer + i, pattern[0], end - i);
+		if (p == NULL) break;
+		i = p - buffer;
+		if (memcmp(p + 1, pattern + 1, length - 1) == 0 &&
+		    add_match(list, base + i) != 0)
+			return -1;
+		i++;
+	}
+
+	return 0;
+}
+
+static void search_segments(void *context, unsigned long first,
+                            unsigned long last)
+{
+	struct search_job *job = context;
+	unsigned char *buffer;
+	unsigned long i;
+
+	buffer = arena_get(SEARCH_SEGMENT + SEARCH_MAX_PATTERN);
+	if (buffer == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	for (i = first; i < last && !job->failed; i++) {
+		unsigned long offset = i * SEARCH_SEGMENT;
+		size_t wanted = SEARCH_SEGMENT + job->length - 1;
+		size_t available;
+
+		if (job->f->size - offset < wanted) wanted = job->f->size - offset;
+		available = file_read_at(job->f, buffer, wanted, offset);
+		if (available != wanted ||
+		    scan(buffer, available, SEARCH_SEGMENT, job->pattern,
+		         job->length, offset, &job->lists[i]) != 0)
+			job->failed = 1;
+	}
+
+	arena_put(buffer);
+}
+
+/* Search one file. The per-segment lists come out in file order, so
+   joining them gives a sorted list. */
+static int search_file(struct search *search, int which, struct file *f)
+{
+	struct search_job job;
+	unsigned long segments, i, total = 0;
+
+	search->matches[which] = NULL;
+	search->count[which] = 0;
+	if (f->pointer == NULL || f->size == 0) return 0;
+
+	segments = (f->size + SEARCH_SEGMENT - 1) / SEARCH_SEGMENT;
+	job.f = f;
+	job.pattern = search->pattern;
+	job.length = search->length;
+	job.failed = 0;
+	job.lists = calloc(segments, sizeof(struct match_list));
+	if (job.lists == NULL) return -1;
+
+	parallel_run_sized(segments, SEARCH_SEGMENT + SEARCH_MAX_PATTERN,
+	                   search_segments, &job);
+
+	for (i = 0; i < segments; i++) total += job.lists[i].count;
+	if (!job.failed && total > 0) {
+		search->matches[which] = malloc(total * sizeof(unsigned long));
+		if (search->matches[which] == NULL) job.failed = 1;
+	}
+	for (i = 0; i < segments; i++) {
+		if (!job.failed && job.lists[i].count > 0) {
+			memcpy(search->matches[which] + search->count[which],
+			       job.lists[i].offsets,
+			       job.lists[i].count * sizeof(unsigned long));
+			search->count[which] += job.lists[i].count;
+		}
+		free(job.lists[i].offsets);
+	}
+
+	free(job.lists);
+	return job.failed ? -1 : 0;
+}
+
+struct search *search_files(const char *text, struct file *file_one,
+                            struct file *file_two)
+{
+	struct search *search = calloc(1, sizeof(*search));
+
+	if (search == NULL) return NULL;
+	search->length = search_parse(text, search->pattern);
+
+	if (search->length == 0 || search_file(search, 0, file_one) != 0 ||
+	    search_file(search, 1, file_two) != 0) {
+		search_free(search);
+		return NULL;
+	}
+
+	return search;
+}
+
+void search_free(struct search *search)
+{
+	if (search == NULL) return;
+	free(search->matches[0]);
+	free(search->matches[1]);
+	free(search);
+}
+
+/* Index of the first match at or after 'offset'. */
+static unsigned long lower_bound(unsigned long *matches, unsigned long count,
+                                 unsigned long offset)
+{
+	unsigned long low = 0, high = count;
+
+	while (low < high) {
+		unsigned long middle = low + (high - low) / 2;
+		if (matches[middle] < offset) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+int search_next(struct search *search, unsigned long offset, int direction,
+                unsigned long *found)
+{
+	int which, result = -1;
+
+	for (which = 0; which < 2; which++) {
+		unsigned long *matches = search->matches[which];
+		unsigned long count = search->count[which], i;
+		unsigned long candidate;
+
+		if (direction >= 0) {
+			if (direction > 0 && offset == (unsigned long) -1) continue;
+			i = lower_bound(matches, count, offset + (direction > 0));
+			if (i == count) continue;
+			candidate = matches[i];
+			if (result == 0 && candidate >= *found) continue;
+		} else {
+			i = lower_bound(matches, count, offset);
+			if (i == 0) continue;
+			candidate = matches[i - 1];
+			if (result == 0 && candidate <= *found) continue;
+		}
+		*found = candidate;
+		result = 0;
+	}
+
+	return result;
+}
+
+unsigned long search_count(struct search *search, unsigned long offset,
+                           unsigned long length)
+{
+	unsigned long total = 0;
+	int which;
+
+	for (which = 0; which < 2; which++)
+		total += lower_bound(search->matches[which], search->count[which],
+		                     offset + length) -
+		         lower_bound(search->matches[which], search->count[which],
+		                     offset);
+	return total;
+}
+
+void search_print(struct search *search, struct file *file_one,
+                  struct file *file_two, FILE *out)
+{
+	struct file *files[2];
+	unsigned long i;
+	int which;
+
+	files[0] = file_one;
+	files[1] = file_two;
+	for (which = 0; which < 2; which++) {
+		for (i = 0; i < search->count[which]; i++)
+			fprintf(out, "%s: 0x%08lx\n", files[which]->name,
+			        files[which]->start + search->matches[which][i]);
+		fprintf(out, "%s: %lu match(es).\n", files[which]->name,
+		        search->count[which]);
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_SEARCH
+#define HEX_SEARCH
+
+#include <stdio.h>
+#include "general.h"
+#include "hexcompare.h"
+
+#define SEARCH_MAX_PATTERN HEXCOMPARE_MAX_PATTERN
+#define SEARCH_SEGMENT 4194304  /* Bytes scanned per work item */
+
+/* Offsets of every match of a pattern in both files. Kept sorted so that
+   stepping from match to match is a binary search. */
+struct search {
+	unsigned char pattern[SEARCH_MAX_PATTERN];
+	size_t length;
+	unsigned long *matches[2];      /* Match offsets, per file */
+	unsigned long count[2];         /* Number of matches       */
+};
+
+/* Turn user input into bytes. "0x" followed by hex digits (spaces are
+   allowed) gives raw bytes, anything else is taken as an ASCII string.
+   Returns the pattern length, or 0 if the input is invalid. */
+size_t search_parse(const char *text, unsigned char *pattern);
+
+/* Scan both files on all threads. Files without local data, i.e. remote
+   agents and signatures, are skipped. Returns NULL on error. */
+struct search *search_files(const char *text, struct file *file_one,
+                            struct file *file_two);
+void search_free(struct search *search);
+
+/* Find the nearest match in either file after 'offset' (direction 1),
+   at or after it (0), or before it (-1). Returns 0 and sets *found, or
+   -1 if there is none. */
+int search_next(struct search *search, unsigned long offset, int direction,
+                unsigned long *found);
+
+/* Number of matches in either file starting within the given range. */
+unsigned long search_count(struct search *search, unsigned long offset,
+                           unsigned long length);
+
+void search_print(struct search *search, struct file *file_one,
+                  struct file *file_two, FILE *out);
+
+#endif
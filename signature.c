@@ -0,0 +1,271 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "signature.h"
+#include "arena.h"
+#include "fileio.h"
+#include "hash.h"
+#include "parallel.h"
+
+/* Work shared by the hashing threads. */
+struct hash_job {
+	struct file *f;
+	unsigned long chunk_size;
+	uint64_t *hashes;
+	int failed;
+};
+
+static void hash_chunks(void *context, unsigned long first,
+                        unsigned long last)
+{
+	struct hash_job *job = context;
+	unsigned char *buffer;
+	unsigned long i;
+
+	buffer = arena_get(job->chunk_size);
+	if (buffer == NULL) {
+		job->failed = 1;
+		return;
+	}
+
+	for (i = first; i < last; i++) {
+		unsigned long offset = i * job->chunk_size;
+		size_t length = job->chunk_size;
+
+		if (job->f->size - offset < length) length = job->f->size - offset;
+		if (file_read_at(job->f, buffer, length, offset) != length) {
+			job->failed = 1;
+			break;
+		}
+		job->hashes[i] = hash64(buffer, length, 0);
+	}
+
+	arena_put(buffer);
+}
+
+static uint64_t *hash_file(struct file *f, unsigned long chunk_size,
+                           unsigned long chunks)
+{
+	struct hash_job job;
+
+	job.f = f;
+	job.chunk_size = chunk_size;
+	job.hashes = malloc((chunks ? chunks : 1) * sizeof(uint64_t));
+	job.failed = 0;
+	if (job.hashes == NULL) return NULL;
+
+	parallel_run_sized(chunks, chunk_size, hash_chunks, &job);
+
+	if (job.failed) {
+		free(job.hashes);
+		return NULL;
+	}
+	return job.hashes;
+}
+
+struct signature *signature_create(struct file *f, unsigned long chunk_size)
+{
+	struct signature *sig;
+
+	if (chunk_size == 0) return NULL;
+	sig = calloc(1, sizeof(*sig));
+	if (sig == NULL) return NULL;
+
+	sig->chunk_size = chunk_size;
+	sig->size = f->size;
+	sig->chunks = (f->size + chunk_size - 1) / chunk_size;
+	sig->hashes = hash_file(f, chunk_size, sig->chunks);
+	if (sig->hashes == NULL) {
+		free(sig);
+		return NULL;
+	}
+
+	return sig;
+}
+
+/* The on-disk format is the magic string followed by chunk size, file
+   size and chunk count, then the hashes, all as little-endian 64-bit
+   values. */
+static int put64(FILE *out, uint64_t value)
+{
+	unsigned char bytes[8];
+
+	hash_store(bytes, value);
+	return fwrite(bytes, 8, 1, out) == 1 ? 0 : -1;
+}
+
+static int get64(FILE *in, uint64_t *value)
+{
+	unsigned char bytes[8];
+
+	if (fread(bytes, 8, 1, in) != 1) return -1;
+	*value = hash_load(bytes);
+	return 0;
+}
+
+/* Whether exactly 'chunks' hashes are left in the file, so that a
+   damaged or crafted header can't make us allocate or read more. */
+static int hashes_left(FILE *in, uint64_t chunks)
+{
+	long here, end;
+
+	if ((here = ftell(in)) < 0 || fseek(in, 0, SEEK_END) != 0 ||
+	    (end = ftell(in)) < 0 || fseek(in, here, SEEK_SET) != 0)
+		return 0;
+	return (uint64_t) (end - here) / 8 == chunks &&
+	       (end - here) % 8 == 0;
+}
+
+int signature_save(struct signature *sig, const char *path)
+{
+	FILE *out;
+	unsigned long i;
+	int result = 0;
+
+	if ((out = fopen(path, "wb")) == NULL) return -1;
+
+	if (fwrite(SIGNATURE_MAGIC, 8, 1, out) != 1) result = -1;
+	if (result == 0) result = put64(out, sig->chunk_size);
+	if (result == 0) result = put64(out, sig->size);
+	if (result == 0) result = put64(out, sig->chunks);
+	for (i = 0; i < sig->chunks && result == 0; i++)
+		result = put64(out, sig->hashes[i]);
+
+	if (fclose(out) != 0) result = -1;
+	return result;
+}
+
+struct signature *signature_load(const char *path)
+{
+	struct signature *sig;
+	char magic[8];
+	uint64_t chunk_size, size, chunks;
+	unsigned long i;
+	FILE *in;
+
+	if ((in = fopen(path, "rb")) == NULL) return NULL;
+
+	/* Check the header before trusting any of the numbers in it. */
+	if (fread(magic, 8, 1, in) != 1 ||
+	    memcmp(magic, SIGNATURE_MAGIC, 8) != 0 ||
+	    get64(in, &chunk_size) != 0 || get64(in, &size) != 0 ||
+	    get64(in, &chunks) != 0 || chunk_size == 0 ||
+	    chunk_size > ULONG_MAX || size > ULONG_MAX ||
+	    chunks > SIZE_MAX / sizeof(uint64_t) ||
+	    chunks != size / chunk_size + (size % chunk_size != 0) ||
+	    !hashes_left(in, chunks)) {
+		fclose(in);
+		return NULL;
+	}
+
+	sig = calloc(1, sizeof(*sig));
+	if (sig == NULL) {
+		fclose(in);
+		return NULL;
+	}
+	sig->chunk_size = (unsigned long) chunk_size;
+	sig->size = (unsigned long) size;
+	sig->chunks = (unsigned long) chunks;
+	sig->hashes = malloc((sig->chunks ? sig->chunks : 1) * sizeof(uint64_t));
+
+	for (i = 0; sig->hashes != NULL && i < sig->chunks; i++) {
+		if (get64(in, &sig->hashes[i]) != 0) {
+			free(sig->hashes);
+			sig->hashes = NULL;
+		}
+	}
+
+	fclose(in);
+	if (sig->hashes == NULL) {
+		free(sig);
+		return NULL;
+	}
+	return sig;
+}
+
+void signature_free(struct signature *sig)
+{
+	if (sig == NULL) return;
+	free(sig->hashes);
+	free(sig->mismatch);
+	free(sig);
+}
+
+long signature_compare(struct signature *sig, struct file *live,
+                       struct diff_index *index)
+{
+	unsigned long live_chunks, i, largest_size;
+	uint64_t *live_hashes;
+	long differing = 0;
+
+	live_chunks = (live->size + sig->chunk_size - 1) / sig->chunk_size;
+	live_hashes = hash_file(live, sig->chunk_size, live_chunks);
+	if (live_hashes == NULL) return -1;
+
+	/* One entry for every chunk that exists in either file. */
+	free(sig->mismatch);
+	sig->compared = (live_chunks > sig->chunks) ? live_chunks : sig->chunks;
+	sig->mismatch = malloc(sig->compared ? sig->compared : 1);
+	if (sig->mismatch == NULL) {
+		free(live_hashes);
+		sig->compared = 0;
+		return -1;
+	}
+
+	largest_size = (live->size > sig->size) ? live->size : sig->size;
+	for (i = 0; i < sig->compared; i++) {
+		unsigned long offset = i * sig->chunk_size;
+		unsigned long length = sig->chunk_size;
+
+		/* A chunk missing from one side, or a short last chunk, hashes
+		   differently from its counterpart. */
+		sig->mismatch[i] = i >= live_chunks || i >= sig->chunks ||
+		                   live_hashes[i] != sig->hashes[i];
+		if (!sig->mismatch[i]) continue;
+
+		differing++;
+		if (index == NULL) continue;
+		if (largest_size - offset < length) length = largest_size - offset;
+		if (diff_index_add_counted(index, offset, length, 0) != 0) {
+			differing = -1;
+			break;
+		}
+	}
+
+	free(live_hashes);
+	return differing;
+}
+
+int signature_range_differs(struct signature *sig, unsigned long offset,
+                            unsigned long length)
+{
+	unsigned long i, last;
+
+	if (sig->mismatch == NULL || sig->compared == 0 || length == 0)
+		return 0;
+
+	last = (offset + length - 1) / sig->chunk_size;
+	if (last >= sig->compared) last = sig->compared - 1;
+
+	for (i = offset / sig->chunk_size; i <= last; i++)
+		if (sig->mismatch[i]) return 1;
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef HEX_SIGNATURE
+#define HEX_SIGNATURE
+
+#include <stdint.h>
+#include "general.h"
+#include "diff.h"
+
+#define SIGNATURE_MAGIC "HXCSIG1"       /* 8 bytes with the terminator */
+#define DEFAULT_CHUNK_SIZE 65536
+
+/* A block-hash manifest: one strong hash per fixed-size chunk of a file.
+   It stands in for a file that isn't available locally. */
+struct signature {
+	unsigned long chunk_size;   /* Bytes covered by each hash       */
+	unsigned long size;         /* Size of the file that was hashed */
+	unsigned long chunks;       /* Number of hashes                 */
+	uint64_t *hashes;           /* One hash per chunk               */
+	unsigned long compared;     /* Number of entries in 'mismatch'  */
+	char *mismatch;             /* Per-chunk result of a comparison */
+};
+
+/* Hash every chunk of a file, using all available threads. */
+struct signature *signature_create(struct file *f, unsigned long chunk_size);
+
+int signature_save(struct signature *sig, const char *path);
+struct signature *signature_load(const char *path);
+void signature_free(struct signature *sig);
+
+/* Hash the live file with the signature's chunk size and mark each chunk
+   whose hash differs. Differing chunks are also added to 'index' when it
+   isn't NULL. Returns the number of differing chunks, or -1 on error. */
+long signature_compare(struct signature *sig, struct file *live,
+                       struct diff_index *index);
+
+/* After signature_compare(), tells whether any chunk overlapping the
+   given range differs. */
+int signature_range_differs(struct signature *sig, unsigned long offset,
+                            unsigned long length);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/* Checks of the library's comparison calls. Run with "make check". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hexcompare.h"
+
+#define TEST_SIZE 10000         /* Bytes in each test file */
+#define TEST_TIMEOUT 10         /* Seconds before a hang counts as failed */
+
+static int failures = 0;
+
+static void check(int condition, const char *what)
+{
+	if (condition) return;
+	printf("FAILED: %s\n", what);
+	failures++;
+}
+
+/* Write 'length' bytes to a new temporary file, named into 'name'. */
+static int write_file(char *name, unsigned char *data, size_t length)
+{
+	int fd = mkstemp(name);
+
+	if (fd < 0) return -1;
+	if (write(fd, data, length) != (ssize_t) length) {
+		close(fd);
+		return -1;
+	}
+	return close(fd);
+}
+
+/* Count the ranges called back, and stop after 'stop' of them if it
+   isn't 0. */
+struct ranges {
+	int count, stop;
+	unsigned long offset, length, differing;
+};
+
+static int count_range(void *user, unsigned long offset,
+                       unsigned long length, unsigned long differing)
+{
+	struct ranges *ranges = user;
+
+	if (ranges->count++ == 0) {
+		ranges->offset = offset;
+		ranges->length = length;
+		ranges->differing = differing;
+	}
+	return ranges->stop != 0 && ranges->count >= ranges->stop;
+}
+
+int main(void)
+{
+	static unsigned char one[TEST_SIZE], two[TEST_SIZE];
+	unsigned char buffer_one[4096], buffer_two[4096];
+	char name_one[] = "/tmp/hexcompare-test-XXXXXX";
+	char name_two[] = "/tmp/hexcompare-test-XXXXXX";
+	struct hexcompare *context;
+	struct ranges ranges;
+	unsigned long mismatches, counts[4];
+	char states[4];
+	int i;
+
+	/* A hang fails the run instead of blocking it. */
+	alarm(TEST_TIMEOUT);
+
+	/* Two ranges differ: 100 bytes at 1000, none of them 0xff before,
+	   and one at 9000. */
+	for (i = 0; i < TEST_SIZE; i++)
+		one[i] = two[i] = (unsigned char) (i % 251);
+	memset(two + 1000, 0xff, 100);
+	two[9000] ^= 1;
+	if (write_file(name_one, one, TEST_SIZE) != 0 ||
+	    write_file(name_two, two, TEST_SIZE) != 0) {
+		printf("Unable to write the test files.\n");
+		return 1;
+	}
+	context = hexcompare_open(name_one, name_two);
+	if (context == NULL) {
+		printf("Unable to open the test files.\n");
+		remove(name_one);
+		remove(name_two);
+		return 1;
+	}
+
+	check(hexcompare_range(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                       sizeof(buffer_one), &mismatches) ==
+	      HEXCOMPARE_DIFFERENT && mismatches == 101, "range");
+	check(hexcompare_range(context, 2000, 1000, buffer_one, buffer_two,
+	                       sizeof(buffer_one), &mismatches) ==
+	      HEXCOMPARE_SAME && mismatches == 0, "equal range");
+	check(hexcompare_range(context, TEST_SIZE, 1000, buffer_one,
+	                       buffer_two, sizeof(buffer_one), &mismatches) ==
+	      HEXCOMPARE_EMPTY, "range past the end");
+	check(hexcompare_range(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                       0, &mismatches) == -1, "range with no buffer");
+
+	memset(&ranges, 0, sizeof(ranges));
+	check(hexcompare_diff(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                      sizeof(buffer_one), count_range, &ranges) == 0 &&
+	      ranges.count == 2 && ranges.offset == 1000 &&
+	      ranges.length == 100 && ranges.differing == 100, "diff");
+	memset(&ranges, 0, sizeof(ranges));
+	ranges.stop = 1;
+	check(hexcompare_diff(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                      sizeof(buffer_one), count_range, &ranges) == 1 &&
+	      ranges.count == 1, "diff stopped by the callback");
+	memset(&ranges, 0, sizeof(ranges));
+	check(hexcompare_diff(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                      0, count_range, &ranges) == -1 &&
+	      ranges.count == 0, "diff with no buffer");
+
+	check(hexcompare_pieces(context, 0, TEST_SIZE, 4, states, counts) ==
+	      0 && states[0] == HEXCOMPARE_DIFFERENT && counts[0] == 100 &&
+	      states[1] == HEXCOMPARE_SAME && states[2] == HEXCOMPARE_SAME &&
+	      states[3] == HEXCOMPARE_DIFFERENT && counts[3] == 1, "pieces");
+
+	hexcompare_cancel(context);
+	check(hexcompare_range(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                       sizeof(buffer_one), &mismatches) ==
+	      HEXCOMPARE_CANCELLED, "range once cancelled");
+	check(hexcompare_diff(context, 0, TEST_SIZE, buffer_one, buffer_two,
+	                      sizeof(buffer_one), count_range, &ranges) ==
+	      HEXCOMPARE_CANCELLED, "diff once cancelled");
+
+	hexcompare_close(context);
+	remove(name_one);
+	remove(name_two);
+	if (failures == 0) printf("All checks passed.\n");
+	return failures != 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "watch.h"
+#include "fileio.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+                      IN_MOVE_SELF | IN_DELETE_SELF)
+#endif
+
+/* Drain pending inotify events, and tell which file they were about.
+   Without inotify, every poll has to look at both files. */
+static void read_events(struct watch *w, int *pending)
+{
+#ifdef __linux__
+	char events[4096];
+	ssize_t result, position;
+	int side;
+
+	if (w->fd >= 0) {
+		pending[0] = pending[1] = 0;
+		for (;;) {
+			result = read(w->fd, events, sizeof(events));
+			if (result < 0 && errno == EINTR) continue;
+			if (result <= 0) break;
+
+			for (position = 0; position < result;
+			     position += sizeof(struct inotify_event) +
+			     ((struct inotify_event *) (events + position))->len) {
+				struct inotify_event *event;
+				event = (struct inotify_event *) (events + position);
+				for (side = 0; side < 2; side++)
+					if (event->wd == w->wd[side]) pending[side] = 1;
+			}
+		}
+		return;
+	}
+#else
+	(void) w;
+#endif
+	pending[0] = pending[1] = 1;
+}
+
+/* If the name now refers to a different file (it was replaced rather than
+   rewritten), switch over to the new one. */
+static void reopen_file(struct watch *w, struct file *f, struct stat *named)
+{
+	struct stat opened;
+	FILE *pointer;
+
+	if (fstat(fileno(f->pointer), &opened) != 0) return;
+	if (opened.st_ino == named->st_ino && opened.st_dev == named->st_dev)
+		return;
+
+	pointer = fopen(f->name, "rb");
+	if (pointer == NULL) return;
+	fclose(f->pointer);
+	f->pointer = pointer;
+
+#ifdef __linux__
+	if (w->fd >= 0) {
+		int wd = inotify_add_watch(w->fd, f->name, WATCH_EVENTS);
+		if (w->files[0] == f) w->wd[0] = wd;
+		if (w->files[1] == f) w->wd[1] = wd;
+	}
+#else
+	(void) w;
+#endif
+}
+
+/* Mark every chunk of 'before' and 'after' whose hash isn't the same in
+   both, or that only one of them has. */
+static void mark_changed(struct watch *w, struct signature *before,
+                         struct signature *after, unsigned long size)
+{
+	unsigned long i, chunks = (size + w->chunk_size - 1) / w->chunk_size;
+
+	for (i = 0; i < chunks && i < w->changed_count; i++) {
+		if (before == NULL || after == NULL ||
+		    i >= before->chunks || i >= after->chunks ||
+		    before->hashes[i] != after->hashes[i])
+			w->changed[i] = 1;
+	}
+}
+
+/* Hash one file again if it changed since the last time. Written to
+   within the same second, the mtime and size may look the same: an event
+   from inotify is enough then. */
+static int update_file(struct watch *w, int side, int event)
+{
+	struct file *f = w->files[side];
+	struct signature *chunks;
+	struct stat named;
+	unsigned long largest;
+
+	if (stat(f->name, &named) != 0) return 0;
+	reopen_file(w, f, &named);
+
+	/* Only the compared range of the file counts. */
+	file_resize(f, named.st_size);
+	if (!event && named.st_mtime == w->mtime[side] &&
+	    f->size == w->size[side] && w->chunks[side] != NULL)
+		return 0;
+
+	/* All of the file is hashed again. Neither inotify nor the mtime
+	   tells which bytes were written, and a file that grew isn't only
+	   appended to: a dump or snapshot is rewritten in place before it
+	   grows. Hashing on all threads reads the file once, less than
+	   comparing every block that might have changed would. */
+	chunks = signature_create(f, w->chunk_size);
+
+	/* Make room to mark chunks up to the end of either version. */
+	largest = (f->size > w->size[side]) ? f->size : w->size[side];
+	largest = (largest + w->chunk_size - 1) / w->chunk_size;
+	if (largest > w->changed_count) {
+		char *changed = realloc(w->changed, largest);
+		if (changed == NULL) {
+			signature_free(chunks);
+			return 0;
+		}
+		memset(changed + w->changed_count, 0,
+		       largest - w->changed_count);
+		w->changed = changed;
+		w->changed_count = largest;
+	}
+	mark_changed(w, w->chunks[side], chunks,
+	             (f->size > w->size[side]) ? f->size : w->size[side]);
+
+	/* A file caught mid-write may fail to hash: try again next time. */
+	signature_free(w->chunks[side]);
+	w->chunks[side] = chunks;
+	w->mtime[side] = named.st_mtime;
+	w->size[side] = f->size;
+	return 1;
+}
+
+struct watch *watch_start(struct file *file_one, struct file *file_two,
+                          unsigned long chunk_size)
+{
+	struct watch *w;
+	int side;
+
+	if (file_one->pointer == NULL || file_two->pointer == NULL)
+		return NULL;
+	w = calloc(1, sizeof(*w));
+	if (w == NULL) return NULL;
+
+	w->fd = -1;
+	w->files[0] = file_one;
+	w->files[1] = file_two;
+	w->chunk_size = chunk_size;
+
+#ifdef __linux__
+	w->fd = inotify_init();
+	if (w->fd >= 0) {
+		fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) | O_NONBLOCK);
+		for (side = 0; side < 2; side++)
+			w->wd[side] = inotify_add_watch(w->fd, w->files[side]->name,
+			                                WATCH_EVENTS);
+	}
+#endif
+
+	/* The first hashes. */
+	for (side = 0; side < 2; side++) {
+		struct stat named;
+
+		if (stat(w->files[side]->name, &named) == 0)
+			w->mtime[side] = named.st_mtime;
+		w->size[side] = w->files[side]->size;
+		w->chunks[side] = signature_create(w->files[side], chunk_size);
+		if (w->chunks[side] == NULL) {
+			watch_stop(w);
+			return NULL;
+		}
+	}
+
+	return w;
+}
+
+void watch_stop(struct watch *w)
+{
+	if (w == NULL) return;
+#ifdef __linux__
+	if (w->fd >= 0) close(w->fd);
+#endif
+	signature_free(w->chunks[0]);
+	signature_free(w->chunks[1]);
+	free(w->changed);
+	free(w);
+}
+
+int watch_poll(struct watch *w)
+{
+	int changed = 0, side, pending[2];
+
+	if (w->changed != NULL) memset(w->changed, 0, w->changed_count);
+	read_events(w, pending);
+
+	/* A file that failed to hash is looked at again every time. */
+	for (side = 0; side < 2; side++)
+		if (pending[side] || w->chunks[side] == NULL)
+			changed |= update_file(w, side, pending[side] &&
+			                       w->fd >= 0);
+
+	return changed;
+}
+
+int watch_range_changed(struct watch *w, unsigned long offset,
+                        unsigned long length)
+{
+	unsigned long i, last;
+
+	if (w->changed == NULL || w->changed_count == 0 || length == 0)
+		return 0;
+
+	last = (offset + length - 1) / w->chunk_size;
+	if (last >= w->changed_count) last = w->changed_count - 1;
+
+	for (i = offset / w->chunk_size; i <= last; i++)
+		if (w->changed[i]) return 1;
+
+	return 0;
+}
+
+int watch_range_differs(struct watch *w, unsigned long offset,
+                        unsigned long length)
+{
+	struct signature *one = w->chunks[0], *two = w->chunks[1];
+	unsigned long i, last;
+
+	if (length == 0) return 0;
+	if (one == NULL || two == NULL) return 1;
+
+	last = (offset + length - 1) / w->chunk_size;
+	for (i = offset / w->chunk_size; i <= last; i++) {
+		if (i >= one->chunks && i >= two->chunks) break;
+		if (i >= one->chunks || i >= two->chunks ||
+		    one->hashes[i] != two->hashes[i])
+			return 1;
+	}
+
+	return 0;
+}
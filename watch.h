@@ -0,0 +1,61 @@
+/*
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef HEX_WATCH
+#define HEX_WATCH
+
+#include <time.h>
+#include "general.h"
+#include "signature.h"
+
+/* Keeps an eye on both files while they are being rewritten. Each file's
+   chunks are hashed once; when the file changes (as told by inotify, or
+   its mtime where there is none), it is hashed again and the chunks whose
+   hashes moved are marked as changed. */
+struct watch {
+	int fd;                       /* inotify descriptor, or -1 to poll  */
+	int wd[2];                    /* inotify watch of each file         */
+	struct file *files[2];        /* The watched files                  */
+	time_t mtime[2];              /* Modification time when last hashed */
+	unsigned long size[2];        /* Size when last hashed              */
+	unsigned long chunk_size;     /* Bytes covered by each hash         */
+	struct signature *chunks[2];  /* Chunk hashes, NULL if unreadable   */
+	unsigned long changed_count;  /* Number of entries in 'changed'     */
+	char *changed;                /* Chunks changed by the last poll    */
+};
+
+/* Start watching both files. Returns NULL on error. */
+struct watch *watch_start(struct file *file_one, struct file *file_two,
+                          unsigned long chunk_size);
+void watch_stop(struct watch *w);
+
+/* Check for changes without blocking. Updates the sizes of the files,
+   and reopens files that were replaced. Returns 1 if either file changed,
+   0 if not. */
+int watch_poll(struct watch *w);
+
+/* After watch_poll(), tells whether any chunk overlapping the range
+   changed. */
+int watch_range_changed(struct watch *w, unsigned long offset,
+                        unsigned long length);
+
+/* Tells whether the files may differ in the range, i.e. whether any
+   chunk overlapping it hashes differently in the two files. */
+int watch_range_differs(struct watch *w, unsigned long offset,
+                        unsigned long length);
+
+#endif